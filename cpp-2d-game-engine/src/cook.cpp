@@ -0,0 +1,277 @@
+// 离线资源烘焙：把资源目录转成引擎可以直接映射的 .pack
+// 用法：mini2d_cook [-m] <输出.pack> <目录>[=<前缀>]...
+//   -m        给纹理生成完整 mip 链
+//   目录=前缀  包内路径为 前缀/相对路径，默认用目录本身的路径；src= 表示不加前缀
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <stb/stb_image.h>
+#include <stb/stb_truetype.h>
+extern "C" {
+#include <lua5.4/lua.h>
+#include <lua5.4/lauxlib.h>
+#include <lua5.4/lualib.h>
+}
+#include "pack.h"
+#include "tools.h"
+
+namespace {
+    namespace fs = std::filesystem;
+    using tools::readAll;
+    using tools::writeChunk;
+
+    struct Item {
+        pack::Entry entry;
+        std::vector<unsigned char> data;
+    };
+
+    std::vector<Item> items;
+
+    Item &addItem(const std::string &name, const pack::Kind kind) {
+        if (name.size() >= pack::NAME_SIZE) {
+            printf("[ERROR] path too long for pack: %s\n", name.c_str());
+            exit(-1);
+        }
+        Item &item = items.emplace_back();
+        memset(&item.entry, 0, sizeof(item.entry));
+        memcpy(item.entry.name, name.c_str(), name.size());
+        item.entry.kind = kind;
+        return item;
+    }
+
+    // 2x2 盒式滤波逐级缩小，奇数边长时最后一列/行重复取
+    void appendMip(std::vector<unsigned char> &data, const size_t srcOffset, const uint32_t sw, const uint32_t sh) {
+        const uint32_t dw = std::max(sw / 2, 1u);
+        const uint32_t dh = std::max(sh / 2, 1u);
+        const size_t dstOffset = data.size();
+        data.resize(dstOffset + static_cast<size_t>(dw) * dh * 4);
+        const unsigned char *src = data.data() + srcOffset;
+        unsigned char *dst = data.data() + dstOffset;
+        for (uint32_t y = 0; y < dh; ++y) {
+            const uint32_t y0 = std::min(y * 2, sh - 1);
+            const uint32_t y1 = std::min(y * 2 + 1, sh - 1);
+            for (uint32_t x = 0; x < dw; ++x) {
+                const uint32_t x0 = std::min(x * 2, sw - 1);
+                const uint32_t x1 = std::min(x * 2 + 1, sw - 1);
+                for (int c = 0; c < 4; ++c) {
+                    const unsigned sum = src[(y0 * sw + x0) * 4 + c] + src[(y0 * sw + x1) * 4 + c] +
+                                         src[(y1 * sw + x0) * 4 + c] + src[(y1 * sw + x1) * 4 + c];
+                    dst[(y * dw + x) * 4 + c] = static_cast<unsigned char>((sum + 2) / 4);
+                }
+            }
+        }
+    }
+
+    void cookTexture(const std::string &name, const std::vector<unsigned char> &file, const bool mips) {
+        int w, h, c;
+        stbi_uc *p = stbi_load_from_memory(file.data(), static_cast<int>(file.size()), &w, &h, &c, 4);
+        if (p == nullptr) {
+            printf("[ERROR] failed to decode %s\n", name.c_str());
+            exit(-1);
+        }
+        Item &item = addItem(name, pack::TEXTURE);
+        item.entry.width = w;
+        item.entry.height = h;
+        item.entry.levels = 1;
+        item.data.assign(p, p + static_cast<size_t>(w) * h * 4);
+        stbi_image_free(p);
+        if (mips) {
+            item.data.reserve(pack::textureBytes(w, h, 32));
+            size_t offset = 0;
+            uint32_t lw = w;
+            uint32_t lh = h;
+            while (lw > 1 || lh > 1) {
+                appendMip(item.data, offset, lw, lh);
+                offset += static_cast<size_t>(lw) * lh * 4;
+                lw = std::max(lw / 2, 1u);
+                lh = std::max(lh / 2, 1u);
+                ++item.entry.levels;
+            }
+        }
+    }
+
+    // 字体文件原样保存（排版还要用度量），再把可打印 ASCII 的距离场字形按行排进一张图集
+    void cookFont(const std::string &name, std::vector<unsigned char> &&file) {
+        stbtt_fontinfo info{};
+        if (!stbtt_InitFont(&info, file.data(), 0)) {
+            printf("[ERROR] failed to parse font %s\n", name.c_str());
+            exit(-1);
+        }
+        const float scale = stbtt_ScaleForPixelHeight(&info, pack::SDF_SIZE);
+        const float distScale = static_cast<float>(pack::SDF_ONEDGE) / pack::SDF_PADDING;
+        constexpr uint32_t PAGE_WIDTH = 512;
+
+        struct Baked {
+            pack::Glyph glyph;
+            unsigned char *sdf;
+        };
+        std::vector<Baked> baked;
+        uint32_t x = 0, y = 0, rowHeight = 0;
+        for (int code = pack::GLYPH_FIRST; code <= pack::GLYPH_LAST; ++code) {
+            int w = 0, h = 0, x0 = 0, y0 = 0;
+            unsigned char *sdf = stbtt_GetCodepointSDF(&info, scale, code, pack::SDF_PADDING, pack::SDF_ONEDGE,
+                                                       distScale, &w, &h, &x0, &y0);
+            pack::Glyph glyph{code, static_cast<int16_t>(x0), static_cast<int16_t>(y0), 0, 0, 0, 0};
+            if (sdf != nullptr) {
+                if (x + w > PAGE_WIDTH) {
+                    x = 0;
+                    y += rowHeight + 1;
+                    rowHeight = 0;
+                }
+                glyph.x = static_cast<uint16_t>(x);
+                glyph.y = static_cast<uint16_t>(y);
+                glyph.w = static_cast<uint16_t>(w);
+                glyph.h = static_cast<uint16_t>(h);
+                x += w + 1;
+                rowHeight = std::max(rowHeight, static_cast<uint32_t>(h));
+            }
+            baked.push_back({glyph, sdf});
+        }
+        const uint32_t pageHeight = y + rowHeight;
+
+        Item &atlas = addItem(name + "#sdf", pack::GLYPHS);
+        atlas.entry.width = PAGE_WIDTH;
+        atlas.entry.height = pageHeight;
+        atlas.entry.levels = static_cast<uint32_t>(baked.size());
+        const size_t headerBytes = baked.size() * sizeof(pack::Glyph);
+        atlas.data.assign(headerBytes + static_cast<size_t>(PAGE_WIDTH) * pageHeight, 0);
+        unsigned char *page = atlas.data.data() + headerBytes;
+        for (size_t i = 0; i < baked.size(); ++i) {
+            const pack::Glyph &glyph = baked[i].glyph;
+            memcpy(atlas.data.data() + i * sizeof(pack::Glyph), &glyph, sizeof(glyph));
+            if (baked[i].sdf == nullptr) {
+                continue;
+            }
+            for (int row = 0; row < glyph.h; ++row) {
+                memcpy(page + (glyph.y + row) * PAGE_WIDTH + glyph.x, baked[i].sdf + row * glyph.w, glyph.w);
+            }
+            stbtt_FreeSDF(baked[i].sdf, nullptr);
+        }
+
+        addItem(name, pack::RAW).data = std::move(file);
+    }
+
+    void cookLua(lua_State *L, const std::string &name, const std::vector<unsigned char> &file) {
+        if (luaL_loadbuffer(L, reinterpret_cast<const char *>(file.data()), file.size(), name.c_str()) != 0) {
+            printf("[ERROR] %s\n", lua_tostring(L, -1));
+            exit(-1);
+        }
+        Item &item = addItem(name, pack::LUA);
+        lua_dump(L, writeChunk, &item.data, 1);
+        lua_pop(L, 1);
+    }
+
+    std::string lower(std::string s) {
+        std::transform(s.begin(), s.end(), s.begin(), [](const unsigned char c) { return std::tolower(c); });
+        return s;
+    }
+
+    void cookDirectory(lua_State *L, const fs::path &dir, const std::string &prefix, const bool mips) {
+        std::vector<fs::path> files;
+        for (const auto &it: fs::recursive_directory_iterator(dir)) {
+            if (it.is_regular_file()) {
+                files.push_back(it.path());
+            }
+        }
+        std::sort(files.begin(), files.end()); // 同样的输入产出同样的包
+        for (const auto &path: files) {
+            std::string name = fs::relative(path, dir).generic_string();
+            if (!prefix.empty()) {
+                name = prefix + "/" + name;
+            }
+            std::vector<unsigned char> file;
+            if (!readAll(path, file)) {
+                printf("[ERROR] failed to read %s\n", path.string().c_str());
+                exit(-1);
+            }
+            const std::string ext = lower(path.extension().string());
+            if (ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp" || ext == ".tga") {
+                cookTexture(name, file, mips);
+            } else if (ext == ".ttf" || ext == ".otf") {
+                cookFont(name, std::move(file));
+            } else if (ext == ".lua") {
+                cookLua(L, name, file);
+            } else {
+                addItem(name, pack::RAW).data = std::move(file);
+            }
+            printf("%s\n", name.c_str());
+        }
+    }
+
+    bool writePack(const char *output) {
+        FILE *f = fopen(output, "wb");
+        if (f == nullptr) {
+            return false;
+        }
+        pack::Header header{};
+        memcpy(header.magic, pack::MAGIC, sizeof(header.magic));
+        header.version = pack::VERSION;
+        header.count = static_cast<uint32_t>(items.size());
+        uint64_t offset = pack::alignUp(sizeof(header));
+        for (auto &item: items) {
+            item.entry.offset = offset;
+            item.entry.size = item.data.size();
+            offset = pack::alignUp(offset + item.data.size());
+        }
+        header.tocOffset = offset;
+
+        static const unsigned char zeros[pack::ALIGN] = {};
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+        uint64_t written = sizeof(header);
+        for (const auto &item: items) {
+            ok = ok && fwrite(zeros, 1, item.entry.offset - written, f) == item.entry.offset - written;
+            ok = ok && fwrite(item.data.data(), 1, item.data.size(), f) == item.data.size();
+            written = item.entry.offset + item.data.size();
+        }
+        ok = ok && fwrite(zeros, 1, header.tocOffset - written, f) == header.tocOffset - written;
+        for (const auto &item: items) {
+            ok = ok && fwrite(&item.entry, sizeof(item.entry), 1, f) == 1;
+        }
+        return fclose(f) == 0 && ok;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    bool mips = false;
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "-m") == 0) {
+        mips = true;
+        ++arg;
+    }
+    if (argc - arg < 2) {
+        printf("usage: %s [-m] <output.pack> <dir>[=<prefix>]...\n", argv[0]);
+        return -1;
+    }
+    const char *output = argv[arg++];
+
+    lua_State *L = luaL_newstate();
+    for (; arg < argc; ++arg) {
+        std::string dir = argv[arg];
+        std::string prefix = dir;
+        const size_t eq = dir.find('=');
+        if (eq != std::string::npos) {
+            prefix = dir.substr(eq + 1);
+            dir.resize(eq);
+        }
+        prefix = fs::path(prefix).lexically_normal().generic_string();
+        if (prefix == ".") {
+            prefix.clear();
+        }
+        while (!prefix.empty() && prefix.back() == '/') {
+            prefix.pop_back();
+        }
+        cookDirectory(L, dir, prefix, mips);
+    }
+    lua_close(L);
+
+    if (!writePack(output)) {
+        printf("[ERROR] failed to write %s\n", output);
+        return -1;
+    }
+    printf("%zu entries -> %s\n", items.size(), output);
+    return 0;
+}
@@ -0,0 +1,86 @@
+// 脚本预编译：把目录下的 .lua 逐个编译成带校验头的 .luac，目录结构不变，再和源码一起打进 zip
+// 用法：mini2d_luac <输出目录> <脚本目录>...
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <miniz.h>
+extern "C" {
+#include <lua5.4/lua.h>
+#include <lua5.4/lauxlib.h>
+#include <lua5.4/lualib.h>
+}
+#include "luac.h"
+#include "tools.h"
+
+namespace {
+    namespace fs = std::filesystem;
+    using tools::readAll;
+    using tools::writeChunk;
+
+    // chunk 名和引擎 require 时用的文件名一致，出错信息才对得上
+    bool compile(lua_State *L, const fs::path &source, const std::string &name, const fs::path &output) {
+        std::vector<unsigned char> text;
+        if (!readAll(source, text)) {
+            printf("[ERROR] failed to read %s\n", source.string().c_str());
+            return false;
+        }
+        if (luaL_loadbuffer(L, reinterpret_cast<const char *>(text.data()), text.size(), name.c_str()) != 0) {
+            printf("[ERROR] %s\n", lua_tostring(L, -1));
+            lua_pop(L, 1);
+            return false;
+        }
+        luac::Header header{};
+        memcpy(header.magic, luac::MAGIC, sizeof(header.magic));
+        header.luaVersion = LUA_VERSION_NUM;
+        header.sourceCrc = static_cast<uint32_t>(mz_crc32(MZ_CRC32_INIT, text.data(), text.size()));
+        header.sourceSize = static_cast<uint32_t>(text.size());
+        std::vector<unsigned char> chunk(reinterpret_cast<const unsigned char *>(&header),
+                                         reinterpret_cast<const unsigned char *>(&header) + sizeof(header));
+        lua_dump(L, writeChunk, &chunk, 1);
+        lua_pop(L, 1);
+
+        fs::create_directories(output.parent_path());
+        FILE *f = fopen(output.string().c_str(), "wb");
+        if (f == nullptr) {
+            printf("[ERROR] failed to write %s\n", output.string().c_str());
+            return false;
+        }
+        const bool ok = fwrite(chunk.data(), 1, chunk.size(), f) == chunk.size();
+        return fclose(f) == 0 && ok;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        printf("usage: %s <output dir> <script dir>...\n", argv[0]);
+        return -1;
+    }
+    const fs::path output = argv[1];
+    lua_State *L = luaL_newstate();
+    int count = 0;
+    bool ok = true;
+    for (int i = 2; i < argc; ++i) {
+        std::vector<fs::path> files;
+        for (const auto &it: fs::recursive_directory_iterator(argv[i])) {
+            if (it.is_regular_file() && it.path().extension() == ".lua") {
+                files.push_back(it.path());
+            }
+        }
+        std::sort(files.begin(), files.end());
+        for (const auto &path: files) {
+            const std::string name = fs::relative(path, argv[i]).generic_string();
+            if (compile(L, path, name, output / (name + luac::SUFFIX))) {
+                printf("%s%s\n", name.c_str(), luac::SUFFIX);
+                ++count;
+            } else {
+                ok = false;
+            }
+        }
+    }
+    lua_close(L);
+    printf("%d chunks -> %s\n", count, output.string().c_str());
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+// mini2d_luac 产出的预编译脚本：Header 后面紧跟去掉调试信息的 lua_dump 字节码。
+// 引擎只在 Lua 版本相同、且（有源码时）源码的 CRC 和长度都对得上时才用它
+#include <cstdint>
+
+namespace luac {
+    constexpr char MAGIC[4] = {'M', '2', 'L', 'C'};
+    constexpr const char *SUFFIX = "c"; // foo.lua -> foo.luac
+
+    struct Header {
+        char magic[4];
+        uint32_t luaVersion; // 编译时的 LUA_VERSION_NUM
+        uint32_t sourceCrc;  // 源码的 CRC-32，和 zip 目录里记录的一致
+        uint32_t sourceSize;
+    };
+
+    static_assert(sizeof(Header) == 16, "luac header layout");
+}
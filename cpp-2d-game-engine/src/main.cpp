@@ -3,11 +3,41 @@
 #include <string>
 #include <glad/glad.h>
 #include <vector>
+#include <cstddef>
+#include <cmath>
+#include <unordered_map>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <list>
+#include <mutex>
+#include <thread>
 #include <stb/stb_image.h>
 #include <stb/stb_truetype.h>
 // #define STB_VORBIS_HEADER_ONLY
 #include <stb/stb_vorbis.c>
 #include <miniz.h>
+#include "luac.h"
+#include "pack.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+// 混音内核的 SIMD 实现：SSE2 是 x86-64 的基线；AVX2 用 target 属性单独编译，运行时检测到才用
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MIX_SSE2 1
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define MIX_AVX2 1
+#endif
 #undef L // conflict between lua and stb_vorbis
 #undef R
 extern "C" {
@@ -20,41 +50,658 @@ static int winW = 640;
 static int winH = 480;
 
 namespace {
+    // glad 只生成了 GL 2.0，VAO、实例化等 3.x 入口在这里手动加载
+    typedef void (APIENTRYP PFNGLGENVERTEXARRAYSPROC)(GLsizei n, GLuint *arrays);
+    typedef void (APIENTRYP PFNGLDELETEVERTEXARRAYSPROC)(GLsizei n, const GLuint *arrays);
+    typedef void (APIENTRYP PFNGLBINDVERTEXARRAYPROC)(GLuint array);
+    typedef void (APIENTRYP PFNGLDRAWARRAYSINSTANCEDPROC)(GLenum mode, GLint first, GLsizei count,
+                                                           GLsizei instancecount);
+    typedef void (APIENTRYP PFNGLVERTEXATTRIBDIVISORPROC)(GLuint index, GLuint divisor);
+
+    PFNGLGENVERTEXARRAYSPROC glGenVertexArrays;
+    PFNGLDELETEVERTEXARRAYSPROC glDeleteVertexArrays;
+    PFNGLBINDVERTEXARRAYPROC glBindVertexArray;
+    PFNGLDRAWARRAYSINSTANCEDPROC glDrawArraysInstanced;
+    PFNGLVERTEXATTRIBDIVISORPROC glVertexAttribDivisor;
+
+    bool loadGL3() {
+        glGenVertexArrays = reinterpret_cast<PFNGLGENVERTEXARRAYSPROC>(SDL_GL_GetProcAddress("glGenVertexArrays"));
+        glDeleteVertexArrays = reinterpret_cast<PFNGLDELETEVERTEXARRAYSPROC>(
+            SDL_GL_GetProcAddress("glDeleteVertexArrays"));
+        glBindVertexArray = reinterpret_cast<PFNGLBINDVERTEXARRAYPROC>(SDL_GL_GetProcAddress("glBindVertexArray"));
+        glDrawArraysInstanced = reinterpret_cast<PFNGLDRAWARRAYSINSTANCEDPROC>(
+            SDL_GL_GetProcAddress("glDrawArraysInstanced"));
+        glVertexAttribDivisor = reinterpret_cast<PFNGLVERTEXATTRIBDIVISORPROC>(
+            SDL_GL_GetProcAddress("glVertexAttribDivisor"));
+        return glGenVertexArrays && glDeleteVertexArrays && glBindVertexArray && glDrawArraysInstanced &&
+               glVertexAttribDivisor;
+    }
+
+    // 只读映射整个文件；不支持的平台上 open 总是失败，调用方退回普通读取
+    class MappedFile {
+        const unsigned char *ptr = nullptr;
+        size_t len = 0;
+
+    public:
+        MappedFile() = default;
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        ~MappedFile() {
+            close();
+        }
+
+        bool open(const char *name) {
+#ifndef _WIN32
+            const int fd = ::open(name, O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat st{};
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                void *p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED) {
+                    ptr = static_cast<const unsigned char *>(p);
+                    len = static_cast<size_t>(st.st_size);
+                }
+            }
+            ::close(fd);
+#endif
+            return ptr != nullptr;
+        }
+
+        void close() {
+#ifndef _WIN32
+            if (ptr) {
+                munmap(const_cast<unsigned char *>(ptr), len);
+            }
+#endif
+            ptr = nullptr;
+            len = 0;
+        }
+
+        [[nodiscard]] const unsigned char *data() const { return ptr; }
+        [[nodiscard]] size_t size() const { return len; }
+    };
+
     class Zip {
+    public:
+        struct Stat {
+            mz_uint index;
+            size_t size;
+            size_t compressedSize;
+            bool directory;
+            bool stored; // 未压缩，且归档已映射时可以零拷贝
+            mz_uint64 localHeaderOffset;
+            mz_uint32 crc32;
+        };
+
+        // 条目内容：borrowed() 为真时直接指向归档映射，不做任何分配和拷贝；
+        // 否则是解压出来的数据，缓冲析构时还给 Zip 的缓冲池
+        class Blob {
+            friend class Zip;
+            const unsigned char *ptr = nullptr;
+            size_t len = 0;
+            std::vector<unsigned char> storage;
+            Zip *owner = nullptr;
+
+        public:
+            Blob() = default;
+
+            Blob(Blob &&other) noexcept
+                : ptr(other.ptr), len(other.len), storage(std::move(other.storage)), owner(other.owner) {
+                other.ptr = nullptr;
+                other.len = 0;
+                other.owner = nullptr;
+            }
+
+            Blob &operator=(Blob &&other) noexcept {
+                if (this != &other) {
+                    release();
+                    ptr = other.ptr;
+                    len = other.len;
+                    storage = std::move(other.storage);
+                    owner = other.owner;
+                    other.ptr = nullptr;
+                    other.len = 0;
+                    other.owner = nullptr;
+                }
+                return *this;
+            }
+
+            ~Blob() {
+                release();
+            }
+
+            void release() {
+                if (owner) {
+                    owner->recycle(std::move(storage));
+                    owner = nullptr;
+                }
+                ptr = nullptr;
+                len = 0;
+            }
+
+            [[nodiscard]] const unsigned char *data() const { return ptr; }
+            [[nodiscard]] size_t size() const { return len; }
+            [[nodiscard]] bool borrowed() const { return ptr != nullptr && owner == nullptr; }
+            explicit operator bool() const { return ptr != nullptr; }
+        };
+
+        // 压缩条目的流式解压，每次 read 只解出调用方要的一小块
+        class Stream {
+            friend class Zip;
+            Zip *owner;
+            mz_zip_reader_extract_iter_state *state;
+
+            Stream(Zip *owner, mz_zip_reader_extract_iter_state *state) : owner(owner), state(state) {
+            }
+
+        public:
+            Stream(const Stream &) = delete;
+            Stream &operator=(const Stream &) = delete;
+
+            ~Stream() {
+                std::lock_guard<std::mutex> lock(owner->mutex);
+                mz_zip_reader_extract_iter_free(state);
+            }
+
+            // 返回读到的字节数，0 表示结束或出错
+            size_t read(void *buffer, const size_t size) {
+                std::lock_guard<std::mutex> lock(owner->mutex);
+                return mz_zip_reader_extract_iter_read(state, buffer, size);
+            }
+        };
+
+    private:
+        static constexpr size_t POOL_SIZE = 4;
+        static constexpr size_t POOL_MAX_BYTES = 4 << 20; // 太大的缓冲不回收
+
         mz_zip_archive zip{};
+        std::mutex mutex; // 索引建好后只读；miniz 解压和缓冲池需要加锁，异步加载线程也会用
+        MappedFile mapped; // mmap 后端的整个归档
+        std::vector<std::vector<unsigned char> > pool;
+        // 打开时把中央目录扫一遍建好索引，之后查找不再让 miniz 逐项比较文件名
+        std::unordered_map<std::string, Stat> entries;
+        std::vector<std::string> names; // 有序，list(prefix) 二分查找
+
+        void buildIndex() {
+            const mz_uint count = mz_zip_reader_get_num_files(&zip);
+            entries.reserve(count);
+            names.reserve(count);
+            mz_zip_archive_file_stat stat;
+            for (mz_uint i = 0; i < count; ++i) {
+                if (!mz_zip_reader_file_stat(&zip, i, &stat)) {
+                    continue;
+                }
+                std::string name = normalize(stat.m_filename);
+                if (name.empty()) {
+                    continue;
+                }
+                const Stat entry{
+                    i, static_cast<size_t>(stat.m_uncomp_size), static_cast<size_t>(stat.m_comp_size),
+                    stat.m_is_directory != MZ_FALSE, stat.m_method == 0, stat.m_local_header_ofs,
+                    stat.m_crc32,
+                };
+                if (entries.emplace(name, entry).second) {
+                    names.push_back(std::move(name));
+                }
+            }
+            std::sort(names.begin(), names.end());
+        }
+
+    public:
+        // 存储条目的数据紧跟在 30 字节的本地文件头、文件名和扩展字段之后
+        [[nodiscard]] const unsigned char *storedData(const Stat &entry) const {
+            if (mapped.data() == nullptr || !entry.stored || entry.localHeaderOffset + 30 > mapped.size()) {
+                return nullptr;
+            }
+            const unsigned char *header = mapped.data() + entry.localHeaderOffset;
+            if (header[0] != 'P' || header[1] != 'K' || header[2] != 3 || header[3] != 4) {
+                return nullptr;
+            }
+            const size_t nameLength = header[26] | (header[27] << 8);
+            const size_t extraLength = header[28] | (header[29] << 8);
+            const size_t offset = entry.localHeaderOffset + 30 + nameLength + extraLength;
+            if (offset + entry.size > mapped.size()) {
+                return nullptr;
+            }
+            return mapped.data() + offset;
+        }
+
+        void recycle(std::vector<unsigned char> &&buffer) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (pool.size() < POOL_SIZE && buffer.capacity() != 0 && buffer.capacity() <= POOL_MAX_BYTES) {
+                pool.push_back(std::move(buffer));
+            }
+        }
 
     public:
         Zip(const char *name) {
             memset(&zip, 0, sizeof(zip));
-            mz_bool ret = mz_zip_reader_init_file(&zip, name, 0);
+            mz_bool ret = MZ_FALSE;
+            if (mapped.open(name)) {
+                ret = mz_zip_reader_init_mem(&zip, mapped.data(), mapped.size(), 0);
+                if (ret == MZ_FALSE) {
+                    mapped.close();
+                }
+            }
+            if (ret == MZ_FALSE) {
+                memset(&zip, 0, sizeof(zip));
+                ret = mz_zip_reader_init_file(&zip, name, 0);
+            }
             if (ret == MZ_FALSE) {
                 printf("file not found: %s\n", name);
                 exit(-1);
             }
+            buildIndex();
         }
 
         ~Zip() {
             mz_zip_reader_end(&zip);
         }
 
-        void *open(const char *name, size_t &size) {
-            return mz_zip_reader_extract_file_to_heap(&zip, name, &size, 0);
+        Zip(const Zip &) = delete;
+        Zip &operator=(const Zip &) = delete;
+
+        // 统一成 a/b/c 形式：反斜杠转斜杠，去掉开头的 / 和 ./，合并重复的 /，去掉目录末尾的 /
+        static std::string normalize(const char *name) {
+            std::string path;
+            for (const char *p = name; *p; ++p) {
+                const char c = *p == '\\' ? '/' : *p;
+                if (c == '/') {
+                    if (path.empty() || path.back() == '/') {
+                        continue;
+                    }
+                    if (path == "." || (path.size() >= 2 && path.compare(path.size() - 2, 2, "/.") == 0)) {
+                        path.pop_back();
+                        continue;
+                    }
+                }
+                path.push_back(c);
+            }
+            if (!path.empty() && path.back() == '/') {
+                path.pop_back();
+            }
+            return path;
+        }
+
+        bool stat(const char *name, Stat &out) const {
+            const auto it = entries.find(normalize(name));
+            if (it == entries.end()) {
+                return false;
+            }
+            out = it->second;
+            return true;
+        }
+
+        [[nodiscard]] bool exists(const char *name) const {
+            return entries.find(normalize(name)) != entries.end();
+        }
+
+        // 列出以 prefix 开头的所有条目（prefix 按原样比较，目录请带上末尾的 /）
+        [[nodiscard]] std::vector<std::string> list(const char *prefix) const {
+            std::string key = prefix;
+            const bool slash = !key.empty() && (key.back() == '/' || key.back() == '\\');
+            key = normalize(key.c_str());
+            if (slash && !key.empty()) {
+                key.push_back('/');
+            }
+            std::vector<std::string> result;
+            for (auto it = std::lower_bound(names.begin(), names.end(), key);
+                 it != names.end() && it->compare(0, key.size(), key) == 0; ++it) {
+                result.push_back(*it);
+            }
+            return result;
+        }
+
+        // 存储条目返回映射内的视图，压缩条目解压进池里的缓冲；找不到时返回空 Blob
+        Blob read(const char *name) {
+            Blob blob;
+            Stat entry{};
+            if (!stat(name, entry) || entry.directory) {
+                return blob;
+            }
+            if (const unsigned char *p = storedData(entry)) {
+                blob.ptr = p;
+                blob.len = entry.size;
+                return blob;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!pool.empty()) {
+                    blob.storage = std::move(pool.back());
+                    pool.pop_back();
+                }
+            }
+            if (!extract(entry, blob.storage)) {
+                recycle(std::move(blob.storage));
+                return Blob();
+            }
+            blob.owner = this;
+            blob.ptr = blob.storage.data();
+            blob.len = blob.storage.size();
+            return blob;
+        }
+
+        // 只在能零拷贝时返回数据（存储条目且归档已映射），否则返回空 Blob
+        Blob view(const char *name) const {
+            Blob blob;
+            Stat entry{};
+            if (stat(name, entry) && !entry.directory) {
+                if (const unsigned char *p = storedData(entry)) {
+                    blob.ptr = p;
+                    blob.len = entry.size;
+                }
+            }
+            return blob;
+        }
+
+        std::unique_ptr<Stream> stream(const char *name) {
+            Stat entry{};
+            if (!stat(name, entry) || entry.directory) {
+                return nullptr;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            mz_zip_reader_extract_iter_state *state = mz_zip_reader_extract_iter_new(&zip, entry.index, 0);
+            if (state == nullptr) {
+                return nullptr;
+            }
+            return std::unique_ptr<Stream>(new Stream(this, state));
+        }
+
+        // 解压（或拷贝）到调用方提供的缓冲，适合本来就要长期持有数据的地方
+        bool readInto(const char *name, std::vector<unsigned char> &out) {
+            Stat entry{};
+            if (!stat(name, entry) || entry.directory) {
+                return false;
+            }
+            return extract(entry, out);
         }
 
-        void close(void *p) {
-            mz_free(p);
+        bool extract(const Stat &entry, std::vector<unsigned char> &out) {
+            // 至少留一个字节，空条目的 data() 也不为空
+            out.resize(entry.size ? entry.size : 1);
+            if (const unsigned char *p = storedData(entry)) {
+                memcpy(out.data(), p, entry.size);
+            } else {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!mz_zip_reader_extract_to_mem(&zip, entry.index, out.data(), out.size(), 0)) {
+                    return false;
+                }
+            }
+            out.resize(entry.size);
+            return true;
         }
+
     };
 
     Zip *gZip;
 
+    // mini2d_cook 烘焙出的资源包：整个映射进来，纹理不用解码直接上传，字体带预烘焙的距离场字形，
+    // 脚本是字节码。包里有的资源优先于磁盘和 zip
+    class Pack {
+        MappedFile mapped;
+        std::unordered_map<std::string, const pack::Entry *> entries; // 建好后只读，工作线程也会查
+
+        // 数据块放得下目录项声称的内容：纹理的各层 mip，字形表加图集页。坏包里的项直接跳过，免得渲染时越界读
+        static bool fits(const pack::Entry &entry) {
+            switch (entry.kind) {
+                case pack::TEXTURE:
+                    return entry.width > 0 && entry.height > 0 && entry.levels > 0 && entry.levels <= 32 &&
+                           entry.size >= pack::textureBytes(entry.width, entry.height, entry.levels);
+                case pack::GLYPHS: // Glyph 里的坐标是 16 位，页再大也用不上
+                    return entry.width <= 0x10000 && entry.height <= 0x10000 &&
+                           entry.size >= static_cast<uint64_t>(entry.levels) * sizeof(pack::Glyph) +
+                                         static_cast<uint64_t>(entry.width) * entry.height;
+                default:
+                    return true;
+            }
+        }
+
+    public:
+        explicit Pack(const char *name) {
+            if (!mapped.open(name)) {
+                return;
+            }
+            pack::Header header{};
+            if (mapped.size() < sizeof(header)) {
+                mapped.close();
+                return;
+            }
+            memcpy(&header, mapped.data(), sizeof(header));
+            if (memcmp(header.magic, pack::MAGIC, sizeof(header.magic)) != 0 || header.version != pack::VERSION ||
+                header.tocOffset > mapped.size() ||
+                static_cast<uint64_t>(header.count) * sizeof(pack::Entry) > mapped.size() - header.tocOffset) {
+                printf("[WARN] ignoring stale or broken pack: %s\n", name);
+                mapped.close();
+                return;
+            }
+            const auto *toc = reinterpret_cast<const pack::Entry *>(mapped.data() + header.tocOffset);
+            entries.reserve(header.count);
+            for (uint32_t i = 0; i < header.count; ++i) {
+                const pack::Entry &entry = toc[i];
+                if (entry.offset > mapped.size() || entry.size > mapped.size() - entry.offset ||
+                    entry.name[pack::NAME_SIZE - 1] != '\0' || !fits(entry)) {
+                    continue;
+                }
+                entries.emplace(entry.name, &entry);
+            }
+        }
+
+        Pack(const Pack &) = delete;
+        Pack &operator=(const Pack &) = delete;
+
+        [[nodiscard]] bool valid() const { return mapped.data() != nullptr; }
+
+        [[nodiscard]] const pack::Entry *find(const char *name, const pack::Kind kind) const {
+            const auto it = entries.find(Zip::normalize(name));
+            return it != entries.end() && it->second->kind == kind ? it->second : nullptr;
+        }
+
+        [[nodiscard]] const pack::Entry *find(const std::string &name, const pack::Kind kind) const {
+            return find(name.c_str(), kind);
+        }
+
+        [[nodiscard]] const unsigned char *data(const pack::Entry &entry) const {
+            return mapped.data() + entry.offset;
+        }
+    };
+
+    Pack *gPack; // 没有资源包时为空
+
+    const pack::Entry *findPacked(const char *name, const pack::Kind kind) {
+        return gPack ? gPack->find(name, kind) : nullptr;
+    }
+
+    struct FrameStats {
+        int drawCalls = 0;
+        int sprites = 0;
+        int stateCalls = 0;  // 真正发给驱动的状态调用
+        int stateElided = 0; // 被 GLState 省掉的状态调用
+    };
+
+    FrameStats gFrameStats;     // 当前帧
+    FrameStats gLastFrameStats; // 上一帧，供 Lua 查询
+
+    // 影子记录当前绑定的 GL 状态，与目标相同的调用直接跳过
+    class GLState {
+        static constexpr int MAX_TEXTURE_UNITS = 16;
+        static constexpr GLuint UNKNOWN = ~0u;
+
+        GLuint program = 0;
+        GLint activeUnit = 0;
+        GLuint textures[MAX_TEXTURE_UNITS]{};
+        GLuint arrayBuffer = 0;
+        GLuint vertexArray = 0;
+        int blend = -1; // -1: 未知
+        GLenum blendSrc = UNKNOWN;
+        GLenum blendDst = UNKNOWN;
+        GLint viewport[4] = {-1, -1, -1, -1};
+
+        static bool issue(const bool changed) {
+            if (changed) {
+                ++gFrameStats.stateCalls;
+            } else {
+                ++gFrameStats.stateElided;
+            }
+            return changed;
+        }
+
+    public:
+        void useProgram(const GLuint id) {
+            if (issue(program != id)) {
+                program = id;
+                glUseProgram(id);
+            }
+        }
+
+        void activeTexture(const GLint unit) {
+            if (issue(activeUnit != unit)) {
+                activeUnit = unit;
+                glActiveTexture(GL_TEXTURE0 + unit);
+            }
+        }
+
+        // 绑定到当前激活的纹理单元
+        void bindTexture(const GLuint id) {
+            bindTexture(activeUnit, id);
+        }
+
+        void bindTexture(const GLint unit, const GLuint id) {
+            if (unit < 0 || unit >= MAX_TEXTURE_UNITS) {
+                activeUnit = unit;
+                glActiveTexture(GL_TEXTURE0 + unit);
+                glBindTexture(GL_TEXTURE_2D, id);
+                return;
+            }
+            if (issue(textures[unit] != id)) {
+                activeTexture(unit);
+                textures[unit] = id;
+                glBindTexture(GL_TEXTURE_2D, id);
+            }
+        }
+
+        void bindArrayBuffer(const GLuint id) {
+            if (issue(arrayBuffer != id)) {
+                arrayBuffer = id;
+                glBindBuffer(GL_ARRAY_BUFFER, id);
+            }
+        }
+
+        void bindVertexArray(const GLuint id) {
+            if (issue(vertexArray != id)) {
+                vertexArray = id;
+                glBindVertexArray(id);
+            }
+        }
+
+        void setBlend(const bool enable) {
+            if (issue(blend != static_cast<int>(enable))) {
+                blend = enable;
+                if (enable) {
+                    glEnable(GL_BLEND);
+                } else {
+                    glDisable(GL_BLEND);
+                }
+            }
+        }
+
+        void blendFunc(const GLenum src, const GLenum dst) {
+            if (issue(blendSrc != src || blendDst != dst)) {
+                blendSrc = src;
+                blendDst = dst;
+                glBlendFunc(src, dst);
+            }
+        }
+
+        void setViewport(const GLint x, const GLint y, const GLsizei w, const GLsizei h) {
+            if (issue(viewport[0] != x || viewport[1] != y || viewport[2] != w || viewport[3] != h)) {
+                viewport[0] = x;
+                viewport[1] = y;
+                viewport[2] = w;
+                viewport[3] = h;
+                glViewport(x, y, w, h);
+            }
+        }
+
+        // 删除对象时调用：GL 会把已删除的绑定回退成 0，影子要跟着同步
+        void forgetProgram(const GLuint id) {
+            if (program == id) {
+                program = UNKNOWN;
+            }
+        }
+
+        void forgetTexture(const GLuint id) {
+            for (auto &texture: textures) {
+                if (texture == id) {
+                    texture = 0;
+                }
+            }
+        }
+
+        void forgetBuffer(const GLuint id) {
+            if (arrayBuffer == id) {
+                arrayBuffer = 0;
+            }
+        }
+
+        void forgetVertexArray(const GLuint id) {
+            if (vertexArray == id) {
+                vertexArray = 0;
+            }
+        }
+    };
+
+    GLState gState;
+
     class Shader {
         GLuint vsID;
         GLuint fsID;
         GLuint programID;
+        unsigned int serial; // 进程内唯一，不随地址或 program 名字复用，缓存按它判断是不是同一个 shader
+        // 链接后一次性反射出所有 active uniform/attribute，之后不再向驱动查询
+        std::unordered_map<std::string, GLint> uniforms;
+        std::unordered_map<std::string, GLint> attribs;
+
+        void reflect() {
+            auto addName = [](std::unordered_map<std::string, GLint> &table, std::string name, GLint location) {
+                // 数组 uniform 报告为 "name[0]"，两种写法都能查到
+                const size_t bracket = name.find('[');
+                if (bracket != std::string::npos) {
+                    table.emplace(name, location);
+                    name.resize(bracket);
+                }
+                table.emplace(name, location);
+            };
+            GLint count = 0, maxLength = 0;
+            glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &count);
+            glGetProgramiv(programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+            std::vector<GLchar> name(maxLength + 1);
+            for (GLint i = 0; i < count; ++i) {
+                GLsizei length = 0;
+                GLint size = 0;
+                GLenum type = 0;
+                glGetActiveUniform(programID, i, static_cast<GLsizei>(name.size()), &length, &size, &type, name.data());
+                addName(uniforms, std::string(name.data(), length), glGetUniformLocation(programID, name.data()));
+            }
+
+            glGetProgramiv(programID, GL_ACTIVE_ATTRIBUTES, &count);
+            glGetProgramiv(programID, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+            name.resize(maxLength + 1);
+            for (GLint i = 0; i < count; ++i) {
+                GLsizei length = 0;
+                GLint size = 0;
+                GLenum type = 0;
+                glGetActiveAttrib(programID, i, static_cast<GLsizei>(name.size()), &length, &size, &type, name.data());
+                addName(attribs, std::string(name.data(), length), glGetAttribLocation(programID, name.data()));
+            }
+        }
 
     public:
         Shader(const char *vsSrc, const char *fsSrc) {
+            static unsigned int nextSerial = 0;
+            serial = ++nextSerial;
             auto checkShaderInfo = [](const GLuint id) {
                 GLint len;
                 glGetShaderiv(id, GL_INFO_LOG_LENGTH, &len);
@@ -90,33 +737,71 @@ namespace {
             glAttachShader(programID, fsID);
             glLinkProgram(programID);
             checkProgramInfo(programID);
+            reflect();
         }
 
         [[nodiscard]] GLuint getID() const { return programID; }
 
-        void attrib(const char *name, const GLint size, const GLenum type, const GLsizei stride = 0,
-                    const void *pointer = nullptr) const {
-            const GLint location = glGetAttribLocation(programID, name);
+        [[nodiscard]] unsigned int getSerial() const { return serial; }
+
+        // 未激活（被优化掉或不存在）的名字返回 -1，和 GL 的约定一致
+        [[nodiscard]] GLint uniform(const char *name) const {
+            const auto it = uniforms.find(name);
+            return it == uniforms.end() ? -1 : it->second;
+        }
+
+        [[nodiscard]] GLint attribute(const char *name) const {
+            const auto it = attribs.find(name);
+            return it == attribs.end() ? -1 : it->second;
+        }
+
+        static void attrib(const GLint location, const GLint size, const GLenum type, const GLsizei stride = 0,
+                           const void *pointer = nullptr, const GLboolean normalized = GL_FALSE) {
+            if (location < 0) {
+                return;
+            }
             glEnableVertexAttribArray(location);
-            glVertexAttribPointer(location, size, type, GL_FALSE, stride, pointer);
+            glVertexAttribPointer(location, size, type, normalized, stride, pointer);
         }
 
-        void setVec4(const char *name, const float v0, const float v1, const float v2, const float v3) const {
+        void attrib(const char *name, const GLint size, const GLenum type, const GLsizei stride = 0,
+                    const void *pointer = nullptr, const GLboolean normalized = GL_FALSE) const {
+            attrib(attribute(name), size, type, stride, pointer, normalized);
+        }
+
+        static void disableAttrib(const GLint location) {
+            if (location >= 0) {
+                glDisableVertexAttribArray(location);
+            }
+        }
+
+        void disableAttrib(const char *name) const {
+            disableAttrib(attribute(name));
+        }
+
+        static void setVec4(const GLint location, const float v0, const float v1, const float v2, const float v3) {
             // x, y, z, w
-            const GLint location = glGetUniformLocation(programID, name);
             glUniform4f(location, v0, v1, v2, v3);
         }
 
-        void setTexture(const char *name, const GLint texture) const {
-            const GLint location = glGetUniformLocation(programID, name);
+        void setVec4(const char *name, const float v0, const float v1, const float v2, const float v3) const {
+            setVec4(uniform(name), v0, v1, v2, v3);
+        }
+
+        static void setTexture(const GLint location, const GLint texture) {
             glUniform1i(location, texture);
         }
 
+        void setTexture(const char *name, const GLint texture) const {
+            setTexture(uniform(name), texture);
+        }
+
         void use() const {
-            glUseProgram(programID);
+            gState.useProgram(programID);
         }
 
         ~Shader() {
+            gState.forgetProgram(programID);
             glDeleteShader(vsID);
             glDeleteShader(fsID);
             glDeleteProgram(programID);
@@ -128,9 +813,8 @@ namespace {
 
         void makeBuffer(const std::vector<float> &point) {
             glGenBuffers(1, &bufferID);
-            glBindBuffer(GL_ARRAY_BUFFER, bufferID);
+            gState.bindArrayBuffer(bufferID);
             glBufferData(GL_ARRAY_BUFFER, point.size() * sizeof(float), point.data(), GL_STATIC_DRAW);
-            glBindBuffer(GL_ARRAY_BUFFER, 0);
         };
 
     public:
@@ -162,436 +846,4814 @@ namespace {
         [[nodiscard]] GLuint getID() const { return bufferID; }
 
         void bind() const {
-            glBindBuffer(GL_ARRAY_BUFFER, bufferID);
+            gState.bindArrayBuffer(bufferID);
         }
 
+        // 绑定是惰性的：引擎里没有依赖 0 号绑定的地方，解绑只为兼容旧脚本，
+        // 这样下一次 bind 同一个对象时就能被 GLState 省掉
         static void unbind() {
-            glBindBuffer(GL_ARRAY_BUFFER, 0);
         }
 
         ~Buffer() {
+            gState.forgetBuffer(bufferID);
             glDeleteBuffers(1, &bufferID);
         }
     };
 
-    class Texture {
-        GLuint textureID;
+    struct VertexAttrib {
+        std::string name;
+        GLint size;
+        GLenum type;
+        GLsizei stride;
+        size_t offset;
+        GLboolean normalized;
+    };
+
+    // 把 Buffer 按 Shader 的属性布局录进 VAO，绘制时只需一次 glBindVertexArray
+    class Mesh {
+        GLuint vertexArrayID{};
 
     public:
-        Texture(const char *name) {
-            int w, h, c;
-            stbi_uc *p = stbi_load(name, &w, &h, &c, 4); // r g b a 四个通道
-            if (p == nullptr) {
-                size_t size;
-                void *data = gZip->open(name, size);
-                if (data == nullptr) {
-                    printf("[ERROR] failed to load %s\n", name);
-                    exit(-1);
-                } else {
-                    p = stbi_load_from_memory(reinterpret_cast<stbi_uc *>(data), static_cast<int>(size), &w, &h, &c, 4);
-                    gZip->close(data);
-                }
+        Mesh(const Buffer &buffer, const Shader &shader, const std::vector<VertexAttrib> &layout) {
+            glGenVertexArrays(1, &vertexArrayID);
+            gState.bindVertexArray(vertexArrayID);
+            buffer.bind();
+            for (const auto &item: layout) {
+                shader.attrib(item.name.c_str(), item.size, item.type, item.stride,
+                              reinterpret_cast<const void *>(item.offset), item.normalized);
             }
-            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-            glGenTextures(1, &textureID);
-            glBindTexture(GL_TEXTURE_2D, textureID);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, p);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            stbi_image_free(p);
+            gState.bindVertexArray(0);
         }
 
-        Texture(const std::vector<unsigned char> &bitmap, int w, int h) {
-            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        Mesh(const Mesh &) = delete;
+        Mesh &operator=(const Mesh &) = delete;
+
+        [[nodiscard]] GLuint getID() const { return vertexArrayID; }
+
+        // VAO 保持绑定，连续画同一个 mesh 时不再重复绑定；
+        // 设置顶点属性的路径（lua attrib、SpriteBatch）会先切回 0 号 VAO
+        void draw(const GLenum mode, const GLint first, const GLsizei count) const {
+            gState.bindVertexArray(vertexArrayID);
+            glDrawArrays(mode, first, count);
+            ++gFrameStats.drawCalls;
+        }
+
+        ~Mesh() {
+            gState.forgetVertexArray(vertexArrayID);
+            glDeleteVertexArrays(1, &vertexArrayID);
+        }
+    };
+
+    // 先按磁盘路径读，再到 zip 里找；返回的像素用 stbi_image_free 释放
+    stbi_uc *loadImage(const char *name, int &w, int &h) {
+        int c;
+        stbi_uc *p = stbi_load(name, &w, &h, &c, 4); // r g b a 四个通道
+        if (p == nullptr) {
+            const Zip::Blob blob = gZip->read(name);
+            if (blob) {
+                p = stbi_load_from_memory(blob.data(), static_cast<int>(blob.size()), &w, &h, &c, 4);
+            }
+        }
+        return p;
+    }
+
+    class Texture {
+        GLuint textureID;
+        int width = 0;
+        int height = 0;
+
+        void makeTexture(const GLenum format, const int w, const int h, const void *pixels) {
+            width = w;
+            height = h;
+            glPixelStorei(GL_UNPACK_ALIGNMENT, format == GL_RGBA ? 4 : 1);
             glGenTextures(1, &textureID);
-            glBindTexture(GL_TEXTURE_2D, textureID);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, w, h, 0, GL_ALPHA, GL_UNSIGNED_BYTE, bitmap.data());
+            gState.bindTexture(textureID);
+            glTexImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(format), w, h, 0, format, GL_UNSIGNED_BYTE, pixels);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         }
 
-        [[nodiscard]] GLuint getID() const { return textureID; }
-
-        void bind(GLint texture) const {
-            glActiveTexture(GL_TEXTURE0 + texture);
-            glBindTexture(GL_TEXTURE_2D, textureID);
+        // 资源包里已经是 RGBA，连同 mip 链直接上传
+        void makeTexture(const pack::Entry &entry, const unsigned char *levels) {
+            makeTexture(GL_RGBA, static_cast<int>(entry.width), static_cast<int>(entry.height), levels);
+            for (uint32_t i = 1; i < entry.levels; ++i) {
+                levels += pack::textureBytes(pack::levelSize(entry.width, i - 1), pack::levelSize(entry.height, i - 1), 1);
+                const auto w = static_cast<GLsizei>(pack::levelSize(entry.width, i));
+                const auto h = static_cast<GLsizei>(pack::levelSize(entry.height, i));
+                glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, levels);
+            }
+            if (entry.levels > 1) {
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(entry.levels - 1));
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            }
         }
 
+    public:
+        Texture(const char *name) {
+            if (const pack::Entry *entry = findPacked(name, pack::TEXTURE)) {
+                makeTexture(*entry, gPack->data(*entry));
+                return;
+            }
+            int w, h;
+            stbi_uc *p = loadImage(name, w, h);
+            if (p == nullptr) {
+                printf("[ERROR] failed to load %s\n", name);
+                exit(-1);
+            }
+            makeTexture(GL_RGBA, w, h, p);
+            stbi_image_free(p);
+        }
+
+        // RGBA 纹理，rgba 为空时只分配存储
+        Texture(int w, int h, const unsigned char *rgba = nullptr) {
+            makeTexture(GL_RGBA, w, h, rgba);
+        }
+
+        Texture(const std::vector<unsigned char> &bitmap, int w, int h) {
+            makeTexture(GL_ALPHA, w, h, bitmap.data());
+        }
+
+        Texture(const Texture &) = delete;
+        Texture &operator=(const Texture &) = delete;
+
+        [[nodiscard]] GLuint getID() const { return textureID; }
+        [[nodiscard]] int getWidth() const { return width; }
+        [[nodiscard]] int getHeight() const { return height; }
+
+        // 只用于 RGBA 纹理
+        void update(const int x, const int y, const int w, const int h, const unsigned char *rgba) const {
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            gState.bindTexture(textureID);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+        }
+
+        void bind(GLint texture) const {
+            gState.bindTexture(texture, textureID);
+        }
+
+        // 同 Buffer::unbind，惰性解绑
         void unbind() const {
-            glBindTexture(GL_TEXTURE_2D, 0);
         }
 
         ~Texture() {
+            gState.forgetTexture(textureID);
             glDeleteTextures(1, &textureID);
         }
     };
 
-    class Font {
-        std::vector<unsigned char> font;
-        stbtt_fontinfo info{};
+    // 驱动允许的最大纹理边长，第一次用时查询
+    int maxTextureSize() {
+        static GLint size = 0;
+        if (size <= 0) {
+            glGetIntegerv(GL_MAX_TEXTURE_SIZE, &size);
+            size = size > 0 ? size : 2048; // 查询失败时保守按 2048 算
+        }
+        return size;
+    }
+
+    // 运行时图集：图片按 skyline（bottom-left）规则增量塞进大纸页，
+    // 塞不下就开新页，已放好的区域从不移动，返回的句柄一直有效（除非整页被 resetPage 清空）
+    class Atlas {
+        struct Node {
+            int x, y, w;
+        };
+
+        struct Page {
+            std::unique_ptr<Texture> texture;
+            std::vector<Node> skyline;
+            int size;
+            long long used = 0; // 已占用的像素数（含 padding）
+        };
 
     public:
-        explicit Font(const char *name) {
-            FILE *f = fopen(name, "rb");
-            if (f == nullptr) {
-                size_t size;
-                void *data = gZip->open(name, size);
-                if (data == nullptr) {
-                    printf("failed to open font file: %s\n", name);
-                    exit(-1);
-                }
-                font.resize(size);
-                memcpy(font.data(), data, size);
-                gZip->close(data);
-            } else {
-                fseek(f, 0, SEEK_END);
-                long size = ftell(f);
-                fseek(f, 0, SEEK_SET);
-                font.resize(size);
-                fread(&font[0], 1, size, f);
-                fclose(f);
+        struct Region {
+            int page;
+            int x, y, w, h;
+            float u0, v0, u1, v1;
+        };
+
+    private:
+        int pageSize;
+        int padding;
+        std::vector<Page> pages;
+        std::vector<Region> regions;
+        std::vector<int> freeRegions; // 被 resetPage 作废、可以复用的句柄
+        std::unordered_map<std::string, int> names;
+
+        // 从 skyline 第 index 个节点开始放 w 宽的矩形，返回放置高度，放不下返回 -1
+        static int fits(const Page &page, size_t index, const int w, const int h) {
+            const int x = page.skyline[index].x;
+            if (x + w > page.size) {
+                return -1;
+            }
+            int y = page.skyline[index].y;
+            int remain = w;
+            while (remain > 0) {
+                if (index == page.skyline.size()) {
+                    return -1;
+                }
+                y = std::max(y, page.skyline[index].y);
+                if (y + h > page.size) {
+                    return -1;
+                }
+                remain -= page.skyline[index].w;
+                ++index;
             }
+            return y;
+        }
 
-            stbtt_InitFont(&info, font.data(), 0);
+        static bool findPosition(const Page &page, const int w, const int h, int &x, int &y, size_t &index) {
+            int bestBottom = page.size + 1;
+            int bestWidth = page.size + 1;
+            bool found = false;
+            for (size_t i = 0; i < page.skyline.size(); ++i) {
+                const int top = fits(page, i, w, h);
+                if (top < 0) {
+                    continue;
+                }
+                if (top + h < bestBottom || (top + h == bestBottom && page.skyline[i].w < bestWidth)) {
+                    bestBottom = top + h;
+                    bestWidth = page.skyline[i].w;
+                    index = i;
+                    x = page.skyline[i].x;
+                    y = top;
+                    found = true;
+                }
+            }
+            return found;
         }
 
-        void makeBitmap(wchar_t code, float size, std::vector<unsigned char> &bitmap, int &x0, int &y0, int &w,
-                        int &h) const {
-            float scale = stbtt_ScaleForPixelHeight(&info, size);
-            int x1, y1;
-            stbtt_GetCodepointBitmapBox(&info, code, scale, scale, &x0, &y0, &x1, &y1);
-            w = x1 - x0;
-            h = y1 - y0;
-            bitmap.resize(w * h);
-            stbtt_MakeCodepointBitmap(&info, bitmap.data(), w, h, w, scale, scale, code);
+        static void addLevel(Page &page, const size_t index, const int x, const int y, const int w, const int h) {
+            auto &skyline = page.skyline;
+            skyline.insert(skyline.begin() + static_cast<std::ptrdiff_t>(index), Node{x, y + h, w});
+            for (size_t i = index + 1; i < skyline.size();) {
+                const int prevRight = skyline[i - 1].x + skyline[i - 1].w;
+                if (skyline[i].x >= prevRight) {
+                    break;
+                }
+                const int shrink = prevRight - skyline[i].x;
+                skyline[i].x += shrink;
+                skyline[i].w -= shrink;
+                if (skyline[i].w > 0) {
+                    break;
+                }
+                skyline.erase(skyline.begin() + static_cast<std::ptrdiff_t>(i));
+            }
+            for (size_t i = 0; i + 1 < skyline.size();) {
+                if (skyline[i].y == skyline[i + 1].y) {
+                    skyline[i].w += skyline[i + 1].w;
+                    skyline.erase(skyline.begin() + static_cast<std::ptrdiff_t>(i + 1));
+                } else {
+                    ++i;
+                }
+            }
+            page.used += static_cast<long long>(w) * h;
         }
-    };
 
-    class Audio {
-        struct Vorbis {
-            stb_vorbis *vorbis = nullptr;
-            int loop = 0;
-            int pause = 0;
-            void *data = nullptr;
-        };
+        Page &newPage(const int size) {
+            Page page;
+            page.size = size;
+            // 和 resetPage 一样从全零开始，线性过滤采到留白时不会带进未定义的像素
+            const std::vector<unsigned char> zeros(static_cast<size_t>(size) * size * 4);
+            page.texture = std::make_unique<Texture>(size, size, zeros.data());
+            page.skyline.push_back({0, 0, size});
+            pages.push_back(std::move(page));
+            return pages.back();
+        }
+
+    public:
+        explicit Atlas(const int pageSize = 1024, const int padding = 1)
+            : pageSize(pageSize), padding(padding < 0 ? 0 : padding) {
+        }
 
-        static constexpr int MAX_AUDIO = 5;
-        SDL_AudioDeviceID audioDeviceID;
-        Vorbis vorbis[MAX_AUDIO];
-        std::vector<short> samples[MAX_AUDIO];
+        Atlas(const Atlas &) = delete;
+        Atlas &operator=(const Atlas &) = delete;
 
-        int findVorbis() const {
-            for (int i = 0; i < MAX_AUDIO; ++i) {
-                if (vorbis[i].pause == 0) {
-                    return i;
+        // 已加载过的同名图片直接返回原句柄；失败返回 -1
+        int add(const char *name) {
+            const auto it = names.find(name);
+            if (it != names.end()) {
+                return it->second;
+            }
+            int w, h;
+            stbi_uc *p = loadImage(name, w, h);
+            if (p == nullptr) {
+                printf("[ERROR] failed to load %s\n", name);
+                return -1;
+            }
+            const int handle = insert(p, w, h);
+            stbi_image_free(p);
+            if (handle >= 0) {
+                names.emplace(name, handle);
+            }
+            return handle;
+        }
+
+        // grow 为 false 时只往已有的页里放，放不下返回 -1
+        int insert(const unsigned char *rgba, const int w, const int h, const bool grow = true) {
+            const int pw = w + padding;
+            const int ph = h + padding;
+            int x = 0, y = 0;
+            size_t index = 0;
+            Page *target = nullptr;
+            int pageIndex = 0;
+            for (auto &page: pages) {
+                if (findPosition(page, pw, ph, x, y, index)) {
+                    target = &page;
+                    break;
+                }
+                ++pageIndex;
+            }
+            if (target == nullptr) {
+                if (!grow) {
+                    return -1;
+                }
+                // 比纸页还大的图单独占一页
+                int size = pageSize;
+                while (size < pw || size < ph) {
+                    if (size > maxTextureSize() / 2) {
+                        return -1; // 超过纹理上限，放不下
+                    }
+                    size *= 2;
+                }
+                target = &newPage(size);
+                pageIndex = static_cast<int>(pages.size()) - 1;
+                if (!findPosition(*target, pw, ph, x, y, index)) {
+                    return -1;
+                }
+            }
+            addLevel(*target, index, x, y, pw, ph);
+            target->texture->update(x, y, w, h, rgba);
+
+            const auto size = static_cast<float>(target->size);
+            const Region region{
+                pageIndex, x, y, w, h,
+                static_cast<float>(x) / size, static_cast<float>(y) / size,
+                static_cast<float>(x + w) / size, static_cast<float>(y + h) / size,
+            };
+            if (!freeRegions.empty()) {
+                const int handle = freeRegions.back();
+                freeRegions.pop_back();
+                regions[handle] = region;
+                return handle;
+            }
+            regions.push_back(region);
+            return static_cast<int>(regions.size()) - 1;
+        }
+
+        // 清空一整页重新排：页上的句柄全部作废（之后可能分给新图），像素清零免得线性过滤采到旧图的边
+        void resetPage(const int index) {
+            Page &page = pages[index];
+            page.skyline.assign(1, Node{0, 0, page.size});
+            page.used = 0;
+            const std::vector<unsigned char> zeros(static_cast<size_t>(page.size) * page.size * 4);
+            page.texture->update(0, 0, page.size, page.size, zeros.data());
+            for (auto it = names.begin(); it != names.end();) {
+                it = regions[it->second].page == index ? names.erase(it) : std::next(it);
+            }
+            for (size_t i = 0; i < regions.size(); ++i) {
+                if (regions[i].page == index) {
+                    regions[i].page = -1;
+                    freeRegions.push_back(static_cast<int>(i));
                 }
             }
-            return -1;
         }
 
+        [[nodiscard]] bool valid(const int handle) const {
+            return handle >= 0 && handle < static_cast<int>(regions.size()) && regions[handle].page >= 0;
+        }
+
+        [[nodiscard]] const Region &region(const int handle) const { return regions[handle]; }
+        [[nodiscard]] int pageCount() const { return static_cast<int>(pages.size()); }
+        [[nodiscard]] const Texture &page(const int index) const { return *pages[index].texture; }
+
+        [[nodiscard]] double occupancy(const int index) const {
+            const auto &page = pages[index];
+            return static_cast<double>(page.used) / (static_cast<double>(page.size) * page.size);
+        }
+    };
+
+    const char *spriteVsSrc = R"(
+        #version 330 core
+        uniform vec4 screen;
+        attribute vec2 position;
+        attribute vec2 texcoord;
+        attribute vec4 color;
+        varying vec2 uv;
+        varying vec4 tint;
+        void main() {
+            float x = 2.0 * position.x / (screen.x - 1.0) - 1.0;
+            float y = 1.0 - 2.0 * position.y / (screen.y - 1.0);
+            gl_Position = vec4(x, y, 0.0, 1.0);
+            uv = texcoord;
+            tint = color;
+        }
+    )";
+
+    const char *spriteFsSrc = R"(
+        #version 330 core
+        uniform sampler2D texture0;
+        varying vec2 uv;
+        varying vec4 tint;
+        void main() {
+            gl_FragColor = tint * texture2D(texture0, uv);
+        }
+    )";
+
+    Shader *gSpriteShader; // SpriteBatch 的默认着色器
+
+    // 0..1 的颜色分量转成归一化的 GL_UNSIGNED_BYTE
+    unsigned char toByte(const float v) {
+        if (v <= 0.0f) {
+            return 0;
+        }
+        if (v >= 1.0f) {
+            return 255;
+        }
+        return static_cast<unsigned char>(v * 255.0f + 0.5f);
+    }
+
+    // 把若干四边形攒进一个流式 VBO，共用一份静态索引缓冲，
+    // 纹理/着色器切换或容量满时才真正提交一次 glDrawElements
+    class SpriteBatch {
+        struct Vertex {
+            float x, y;
+            float u, v;
+            unsigned char r, g, b, a;
+        };
+
+        static constexpr int MAX_SPRITES = 65536 / 4; // 索引用 GLushort
+
+        GLuint vertexBufferID{};
+        GLuint indexBufferID{};
+        int capacity;
+        std::vector<Vertex> vertices;
+        const Shader *shader = nullptr;
+        GLuint textureID = 0;
+        int draws = 0;
+        int sprites = 0;
+
     public:
-        Audio() {
-            SDL_AudioSpec spec;
-            spec.freq = 44100;
-            spec.format = AUDIO_S16;
-            spec.channels = 2;
-            spec.samples = 1024;
-            spec.callback = nullptr;
-            spec.userdata = nullptr;
-            audioDeviceID = SDL_OpenAudioDevice(nullptr, 0, &spec, nullptr, 0);
+        explicit SpriteBatch(const int capacity = 4096)
+            : capacity(capacity < 1 ? 1 : (capacity > MAX_SPRITES ? MAX_SPRITES : capacity)) {
+            vertices.reserve(this->capacity * 4);
+
+            std::vector<GLushort> indices(this->capacity * 6);
+            for (int i = 0; i < this->capacity; ++i) {
+                // 顶点顺序 lt, lb, rt, rb，和 Buffer 的 TRIANGLE_STRIP 一致
+                const auto base = static_cast<GLushort>(i * 4);
+                indices[i * 6 + 0] = base + 0;
+                indices[i * 6 + 1] = base + 1;
+                indices[i * 6 + 2] = base + 2;
+                indices[i * 6 + 3] = base + 2;
+                indices[i * 6 + 4] = base + 1;
+                indices[i * 6 + 5] = base + 3;
+            }
+            // 索引缓冲的绑定属于 VAO 状态，必须在 0 号 VAO 上操作
+            gState.bindVertexArray(0);
+            glGenBuffers(1, &indexBufferID);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+
+            glGenBuffers(1, &vertexBufferID);
+            gState.bindArrayBuffer(vertexBufferID);
+            glBufferData(GL_ARRAY_BUFFER, this->capacity * 4 * sizeof(Vertex), nullptr, GL_STREAM_DRAW);
         }
 
-        ~Audio() {
-            SDL_PauseAudioDevice(audioDeviceID, 1);
-            SDL_CloseAudioDevice(audioDeviceID);
-            for (const auto &item: vorbis) {
-                stb_vorbis_close(item.vorbis);
-                gZip->close(item.data);
+        ~SpriteBatch() {
+            gState.forgetBuffer(vertexBufferID);
+            glDeleteBuffers(1, &vertexBufferID);
+            glDeleteBuffers(1, &indexBufferID);
+        }
+
+        SpriteBatch(const SpriteBatch &) = delete;
+        SpriteBatch &operator=(const SpriteBatch &) = delete;
+
+        void begin() {
+            vertices.clear();
+            draws = 0;
+            sprites = 0;
+        }
+
+        void setShader(const Shader *s) {
+            if (s != shader) {
+                flush();
+                shader = s;
             }
         }
 
-        int open(const char *name, const int loop = 1) {
-            int idx = findVorbis();
-            if (idx == -1) {
-                return -1;
+        void draw(const GLuint texture, const float x, const float y, const float w, const float h,
+                  const float u0 = 0, const float v0 = 0, const float u1 = 1, const float v1 = 1,
+                  const float r = 1, const float g = 1, const float b = 1, const float a = 1) {
+            if (texture != textureID) {
+                flush();
+                textureID = texture;
             }
-            int error = 0;
-            vorbis[idx].vorbis = stb_vorbis_open_filename(name, &error, nullptr);
-            if (vorbis[idx].vorbis == nullptr) {
-                size_t size;
-                void *data = gZip->open(name, size);
-                if (data == nullptr) {
-                    printf("failed to open file: %s\n", name);
-                    exit(-1);
-                }
-                vorbis[idx].data = data;
-                vorbis[idx].vorbis = stb_vorbis_open_memory(reinterpret_cast<const unsigned char *>(data),
-                                                            static_cast<int>(size), &error, nullptr);
+            if (static_cast<int>(vertices.size()) >= capacity * 4) {
+                flush();
             }
-            vorbis[idx].loop = loop;
-            vorbis[idx].pause = 0;
-            return idx;
-            // SDL_PauseAudioDevice(audioDeviceID, 0);
+            const unsigned char cr = toByte(r), cg = toByte(g), cb = toByte(b), ca = toByte(a);
+            vertices.push_back({x, y, u0, v0, cr, cg, cb, ca});
+            vertices.push_back({x, y + h, u0, v1, cr, cg, cb, ca});
+            vertices.push_back({x + w, y, u1, v0, cr, cg, cb, ca});
+            vertices.push_back({x + w, y + h, u1, v1, cr, cg, cb, ca});
+            ++sprites;
+            ++gFrameStats.sprites;
         }
 
-        void close(const int idx) {
-            stb_vorbis_close(vorbis[idx].vorbis);
-            gZip->close(vorbis[idx].data);
-            vorbis[idx] = Vorbis();
+        void flush() {
+            if (vertices.empty()) {
+                return;
+            }
+            const Shader *s = shader ? shader : gSpriteShader;
+            const auto count = static_cast<GLsizei>(vertices.size() / 4 * 6);
+
+            gState.bindVertexArray(0);
+            gState.bindArrayBuffer(vertexBufferID);
+            // 先丢弃旧存储再写入，避免等待上一次 draw 仍在使用的缓冲
+            glBufferData(GL_ARRAY_BUFFER, capacity * 4 * sizeof(Vertex), nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(Vertex), vertices.data());
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+
+            const GLint texcoord = s->attribute("texcoord");
+            const GLint color = s->attribute("color");
+            Shader::attrib(s->attribute("position"), 2, GL_FLOAT, sizeof(Vertex),
+                           reinterpret_cast<const void *>(offsetof(Vertex, x)));
+            Shader::attrib(texcoord, 2, GL_FLOAT, sizeof(Vertex), reinterpret_cast<const void *>(offsetof(Vertex, u)));
+            Shader::attrib(color, 4, GL_UNSIGNED_BYTE, sizeof(Vertex),
+                           reinterpret_cast<const void *>(offsetof(Vertex, r)), GL_TRUE);
+            s->use();
+            Shader::setVec4(s->uniform("screen"), static_cast<float>(winW), static_cast<float>(winH), 0.0f, 0.0f);
+            Shader::setTexture(s->uniform("texture0"), 0);
+            gState.bindTexture(0, textureID);
+
+            glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_SHORT, nullptr);
+
+            Shader::disableAttrib(texcoord);
+            Shader::disableAttrib(color);
+
+            vertices.clear();
+            ++draws;
+            ++gFrameStats.drawCalls;
         }
 
-        void play() {
-            Uint32 queuedAudioSize = SDL_GetQueuedAudioSize(audioDeviceID);
-            if (queuedAudioSize == 0) {
-                for (int i = 0; i < MAX_AUDIO; ++i) {
-                    if (!vorbis[i].vorbis || vorbis[i].pause) {
-                        continue;
-                    }
-                    samples[i].resize(2048);
-                    int ret = stb_vorbis_get_samples_short_interleaved(vorbis[i].vorbis, 2, samples[i].data(),
-                                                                       static_cast<int>(samples[i].size()));
-                    if (ret == 0) {
-                        stb_vorbis_seek_start(vorbis[i].vorbis);
-                        if (!vorbis[i].loop) {
-                            vorbis[i].pause = 1;
-                        }
-                    }
-                }
-                std::vector<short> samples_mix(2048);
-                for (size_t k = 0; k < samples_mix.size(); ++k) {
-                    int sample = 0;
-                    for (int i = 0; i < MAX_AUDIO; ++i) {
-                        if (!vorbis[i].vorbis || vorbis[i].pause) {
-                            continue;
-                        }
-                        sample += samples[i][k];
-                    }
-                    constexpr int s16max = static_cast<short>(0x7FFF);
-                    constexpr int s16min = static_cast<short>(0x8000);
-                    if (sample > s16max) {
-                        sample = s16max;
-                    }
-                    if (sample < s16min) {
-                        sample = s16min;
-                    }
-                    samples_mix[k] = static_cast<short>(sample);
+        [[nodiscard]] int getDraws() const { return draws; }
+        [[nodiscard]] int getSprites() const { return sprites; }
+    };
+
+    const char *rectVsSrc = R"(
+        #version 330 core
+        uniform vec4 screen;
+        attribute vec2 position;
+        attribute vec4 pos_size; // 每实例：x, y, w, h
+        attribute vec3 rotation; // 每实例：旋转中心相对矩形中心的偏移 ox, oy，角度
+        attribute vec4 color;    // 每实例
+        varying vec4 tint;
+        void main() {
+            vec2 p = position * pos_size.zw - rotation.xy;
+            float theta = radians(rotation.z);
+            float c = cos(theta);
+            float s = sin(theta);
+            p = vec2(c * p.x - s * p.y, s * p.x + c * p.y) + rotation.xy + pos_size.xy;
+
+            float x = 2.0 * p.x / (screen.x - 1.0) - 1.0;
+            float y = 1.0 - 2.0 * p.y / (screen.y - 1.0);
+            gl_Position = vec4(x, y, 0.0, 1.0);
+            tint = color;
+        }
+    )";
+
+    const char *rectFsSrc = R"(
+        #version 330 core
+        varying vec4 tint;
+        void main() {
+            gl_FragColor = tint;
+        }
+    )";
+
+    Shader *gRectShader; // drawRectsInstanced 的默认着色器
+
+    // 每个矩形的数据放进实例 VBO，N 个矩形一次上传、一次 glDrawArraysInstanced
+    class InstanceBuffer {
+        struct Instance {
+            float x, y, w, h;
+            float ox, oy, angle;
+            unsigned char r, g, b, a;
+        };
+
+        GLuint quadBufferID{};
+        GLuint instanceBufferID{};
+        GLuint vertexArrayID{};
+        unsigned int layoutSerial = 0; // VAO 按哪个 shader 的属性位置录制，0 表示还没录
+        std::vector<Instance> instances;
+        bool dirty = false;
+
+        void record(const Shader &shader) {
+            gState.bindVertexArray(vertexArrayID);
+            gState.bindArrayBuffer(quadBufferID);
+            Shader::attrib(shader.attribute("position"), 2, GL_FLOAT);
+
+            gState.bindArrayBuffer(instanceBufferID);
+            auto instanced = [&](const char *name, const GLint size, const GLenum type, const size_t offset,
+                                 const GLboolean normalized) {
+                const GLint location = shader.attribute(name);
+                if (location >= 0) {
+                    Shader::attrib(location, size, type, sizeof(Instance), reinterpret_cast<const void *>(offset),
+                                   normalized);
+                    glVertexAttribDivisor(location, 1);
                 }
-                SDL_QueueAudio(audioDeviceID, samples_mix.data(),
-                               static_cast<Uint32>(samples_mix.size()) * sizeof(short));
-            }
+            };
+            instanced("pos_size", 4, GL_FLOAT, offsetof(Instance, x), GL_FALSE);
+            instanced("rotation", 3, GL_FLOAT, offsetof(Instance, ox), GL_FALSE);
+            instanced("color", 4, GL_UNSIGNED_BYTE, offsetof(Instance, r), GL_TRUE);
+            layoutSerial = shader.getSerial();
+        }
+
+    public:
+        explicit InstanceBuffer(const int capacity = 256) {
+            instances.reserve(capacity > 0 ? capacity : 1);
+            const float quad[] = {
+                -0.5f, -0.5f,
+                -0.5f, 0.5f,
+                0.5f, -0.5f,
+                0.5f, 0.5f,
+            };
+            glGenBuffers(1, &quadBufferID);
+            gState.bindArrayBuffer(quadBufferID);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+            glGenBuffers(1, &instanceBufferID);
+            glGenVertexArrays(1, &vertexArrayID);
+        }
+
+        ~InstanceBuffer() {
+            gState.forgetVertexArray(vertexArrayID);
+            gState.forgetBuffer(quadBufferID);
+            gState.forgetBuffer(instanceBufferID);
+            glDeleteVertexArrays(1, &vertexArrayID);
+            glDeleteBuffers(1, &quadBufferID);
+            glDeleteBuffers(1, &instanceBufferID);
+        }
+
+        InstanceBuffer(const InstanceBuffer &) = delete;
+        InstanceBuffer &operator=(const InstanceBuffer &) = delete;
+
+        void clear() {
+            instances.clear();
+            dirty = true;
         }
 
-        void pause(int pause) const {
-            SDL_PauseAudioDevice(audioDeviceID, pause);
+        void add(const float x, const float y, const float w, const float h,
+                 const float ox, const float oy, const float angle,
+                 const float r, const float g, const float b, const float a) {
+            instances.push_back({x, y, w, h, ox, oy, angle, toByte(r), toByte(g), toByte(b), toByte(a)});
+            dirty = true;
+        }
+
+        [[nodiscard]] int count() const { return static_cast<int>(instances.size()); }
+
+        void draw(const Shader &shader) {
+            if (instances.empty()) {
+                return;
+            }
+            if (dirty) {
+                // 整块重新指定存储，顺带丢弃上一帧还在用的旧缓冲
+                gState.bindArrayBuffer(instanceBufferID);
+                glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance), instances.data(), GL_STREAM_DRAW);
+                dirty = false;
+            }
+            if (layoutSerial != shader.getSerial()) {
+                record(shader);
+            }
+            shader.use();
+            Shader::setVec4(shader.uniform("screen"), static_cast<float>(winW), static_cast<float>(winH), 0.0f, 0.0f);
+            gState.bindVertexArray(vertexArrayID);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(instances.size()));
+            ++gFrameStats.drawCalls;
         }
     };
 
-    Audio* gAudio;
+    // 依次找资源包、磁盘和 zip，整个文件读进 data
+    bool readFile(const char *name, std::vector<unsigned char> &data) {
+        if (const pack::Entry *entry = findPacked(name, pack::RAW)) {
+            const unsigned char *p = gPack->data(*entry);
+            data.assign(p, p + entry->size);
+            return true;
+        }
+        FILE *f = fopen(name, "rb");
+        if (f == nullptr) {
+            return gZip->readInto(name, data);
+        }
+        fseek(f, 0, SEEK_END);
+        const long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        data.resize(size > 0 ? size : 0);
+        const size_t read = size > 0 ? fread(data.data(), 1, data.size(), f) : 0;
+        fclose(f);
+        return read == data.size();
+    }
 
-    int lua_error_callback(lua_State *L) {
-        const char *error = lua_tostring(L, 1);
-        luaL_traceback(L, L, error, 0);
-        return 1;
+    // 和 readFile 同样的查找顺序，只取文件大小，不读内容
+    bool fileSize(const char *name, size_t &size) {
+        if (const pack::Entry *entry = findPacked(name, pack::RAW)) {
+            size = entry->size;
+            return true;
+        }
+        struct stat st {};
+        if (::stat(name, &st) == 0) {
+            size = static_cast<size_t>(st.st_size);
+            return true;
+        }
+        Zip::Stat entry{};
+        if (gZip->stat(name, entry)) {
+            size = entry.size;
+            return true;
+        }
+        return false;
     }
 
-    int lua_ziploader(lua_State* L) {
-        std::string name = luaL_checkstring(L, 1);
-        for (size_t i = 0; i < name.size(); ++i) {
-            if (name[i] == '.') { // 不能用双引号：""自带\0，要用''
-                name[i] = '/';
+    class Font {
+        std::vector<unsigned char> font;
+        stbtt_fontinfo info{};
+        unsigned int id; // 字形缓存的键，不用指针以免地址被复用
+        const pack::Entry *baked = nullptr; // 资源包里预烘焙的距离场字形
+
+        static unsigned int nextID() {
+            static std::atomic<unsigned int> counter{0}; // 异步加载线程也会构造 Font
+            return ++counter;
+        }
+
+    public:
+        explicit Font(const char *name) : id(nextID()) {
+            // 字体要常驻，直接读进自己的缓冲
+            if (!readFile(name, font)) {
+                printf("failed to open font file: %s\n", name);
+                exit(-1);
             }
+            stbtt_InitFont(&info, font.data(), 0);
+            baked = findPacked((Zip::normalize(name) + "#sdf").c_str(), pack::GLYPHS);
         }
-        name += ".lua";
-        size_t size;
-        void* p = gZip->open(name.c_str(), size);
-        if (p == nullptr) {
-            luaL_error(L, "%s not found!", name.c_str());
-            return 0;
+
+        // data 必须是已经读好的字体文件，name 用来找预烘焙的字形
+        Font(std::vector<unsigned char> &&data, const char *name) : font(std::move(data)), id(nextID()) {
+            stbtt_InitFont(&info, font.data(), 0);
+            baked = findPacked((Zip::normalize(name) + "#sdf").c_str(), pack::GLYPHS);
         }
-        lua_pushcfunction(L, lua_error_callback);
-        int ret = luaL_loadbuffer(L, static_cast<const char *>(p), size, name.c_str());
-        if (ret == 0) {
-            ret = lua_pcall(L, 0, 1, -2);
+
+        void makeBitmap(wchar_t code, float size, std::vector<unsigned char> &bitmap, int &x0, int &y0, int &w,
+                        int &h) const {
+            float scale = stbtt_ScaleForPixelHeight(&info, size);
+            int x1, y1;
+            stbtt_GetCodepointBitmapBox(&info, code, scale, scale, &x0, &y0, &x1, &y1);
+            w = x1 - x0;
+            h = y1 - y0;
+            bitmap.resize(w * h);
+            stbtt_MakeCodepointBitmap(&info, bitmap.data(), w, h, w, scale, scale, code);
         }
-        if (ret) {
-            printf("%s\n", lua_tostring(L, -1));
+
+        // 有向距离场：边缘处取 onedge，向外每像素减 distScale；返回的位图用 stbtt_FreeSDF 释放
+        unsigned char *makeSDF(const int code, const float size, const int padding, const unsigned char onedge,
+                               const float distScale, int &x0, int &y0, int &w, int &h) const {
+            const float scale = stbtt_ScaleForPixelHeight(&info, size);
+            return stbtt_GetCodepointSDF(&info, scale, code, padding, onedge, distScale, &w, &h, &x0, &y0);
+        }
+
+        // 预烘焙的距离场字形；没有时返回 nullptr。page 指向单通道图集页，pitch 为行宽
+        const pack::Glyph *bakedSDF(const int code, const unsigned char *&page, int &pitch) const {
+            const int index = code - pack::GLYPH_FIRST;
+            if (baked == nullptr || index < 0 || index >= static_cast<int>(baked->levels)) {
+                return nullptr;
+            }
+            const auto *glyphs = reinterpret_cast<const pack::Glyph *>(gPack->data(*baked));
+            const pack::Glyph *glyph = &glyphs[index];
+            if (glyph->code != code || glyph->x + glyph->w > baked->width || glyph->y + glyph->h > baked->height) {
+                return nullptr; // 落在页外的按没有预烘焙处理，运行时再算
+            }
+            page = gPack->data(*baked) + baked->levels * sizeof(pack::Glyph);
+            pitch = static_cast<int>(baked->width);
+            return glyph;
+        }
+
+        ~Font();
+
+        Font(const Font &) = delete;
+        Font &operator=(const Font &) = delete;
+
+        [[nodiscard]] unsigned int getID() const { return id; }
+        [[nodiscard]] size_t byteSize() const { return font.size(); }
+
+        [[nodiscard]] float scaleFor(const float size) const {
+            return stbtt_ScaleForPixelHeight(&info, size);
+        }
+
+        [[nodiscard]] float advance(const int code, const float scale) const {
+            int advanceWidth, leftSideBearing;
+            stbtt_GetCodepointHMetrics(&info, code, &advanceWidth, &leftSideBearing);
+            return static_cast<float>(advanceWidth) * scale;
+        }
+
+        [[nodiscard]] float kern(const int prev, const int code, const float scale) const {
+            return static_cast<float>(stbtt_GetCodepointKernAdvance(&info, prev, code)) * scale;
+        }
+
+        void verticalMetrics(const float scale, float &ascent, float &lineHeight) const {
+            int a, d, gap;
+            stbtt_GetFontVMetrics(&info, &a, &d, &gap);
+            ascent = static_cast<float>(a) * scale;
+            lineHeight = static_cast<float>(a - d + gap) * scale;
         }
-        gZip->close(p);
+
+        struct SDFStyle {
+            // 描边和发光加起来最多 SDF_PADDING * size / SDF_SIZE 屏幕像素：字形四边只留了这么宽的距离场，再宽会被方框截断
+            float outline = 0; // 描边宽度，屏幕像素
+            float outlineColor[4] = {0, 0, 0, 1};
+            float glow = 0; // 外发光宽度，屏幕像素，排在描边外面
+            float glowColor[4] = {0, 0, 0, 0.5f};
+        };
+
+        // 返回最宽一行的宽度；sdf 非空时走距离场字形
+        float drawText(const char *text, float x, float y, float size, float r, float g, float b, float a,
+                       const SDFStyle *sdf = nullptr) const;
+    };
+
+    // 解出一个 UTF-8 码点并前移 p，非法字节按 U+FFFD 处理
+    int decodeUTF8(const char *&p) {
+        const auto c = static_cast<unsigned char>(*p++);
+        int count;
+        int code;
+        if (c < 0x80) {
+            return c;
+        } else if ((c & 0xE0) == 0xC0) {
+            count = 1;
+            code = c & 0x1F;
+        } else if ((c & 0xF0) == 0xE0) {
+            count = 2;
+            code = c & 0x0F;
+        } else if ((c & 0xF8) == 0xF0) {
+            count = 3;
+            code = c & 0x07;
+        } else {
+            return 0xFFFD;
+        }
+        for (int i = 0; i < count; ++i) {
+            const auto next = static_cast<unsigned char>(*p);
+            if ((next & 0xC0) != 0x80) {
+                return 0xFFFD;
+            }
+            code = (code << 6) | (next & 0x3F);
+            ++p;
+        }
+        return code;
+    }
+
+    // 字形按 (字体, 码点, 像素大小) 缓存，首次用到时光栅化进共享图集
+    class GlyphCache {
+    public:
+        struct Glyph {
+            int region; // 图集句柄，空白字形为 -1
+            int x0, y0; // 相对笔位置/基线的偏移
+            int w, h;
+        };
+
+        // 距离场字形只在这个参考尺寸下烘焙一次，任意字号都从它缩放
+        static constexpr int SDF_SIZE = pack::SDF_SIZE;
+        static constexpr int SDF_PADDING = pack::SDF_PADDING;
+        static constexpr unsigned char SDF_ONEDGE = pack::SDF_ONEDGE;
+        static constexpr float SDF_DIST_SCALE = static_cast<float>(SDF_ONEDGE) / SDF_PADDING;
+
+    private:
+        struct Key {
+            unsigned int font;
+            int code;
+            int size; // 距离场字形为 0
+
+            bool operator==(const Key &other) const {
+                return font == other.font && code == other.code && size == other.size;
+            }
+        };
+
+        struct KeyHash {
+            size_t operator()(const Key &key) const {
+                size_t h = key.font;
+                h = h * 0x9E3779B1u + static_cast<size_t>(key.code);
+                h = h * 0x9E3779B1u + static_cast<size_t>(key.size);
+                return h;
+            }
+        };
+
+        // 页数到上限后不再开新页，而是清空最久没用过的一页，上面的字形下次用到时重新光栅化
+        static constexpr int MAX_PAGES = 4;
+
+        struct PageUse {
+            int glyphs = 0;         // 页上还在缓存里的字形数
+            unsigned long long last = 0; // 最后一次被哪次 beginText 用到
+        };
+
+        Atlas atlas;
+        std::unordered_map<Key, Glyph, KeyHash> glyphs;
+        std::vector<PageUse> pageUse;
+        unsigned long long textSerial = 1;
+        std::vector<unsigned char> bitmap;
+        std::vector<unsigned char> rgba;
+
+        const Glyph &touch(const Glyph &glyph) {
+            if (glyph.region >= 0) {
+                pageUse[atlas.region(glyph.region).page].last = textSerial;
+            }
+            return glyph;
+        }
+
+        const Glyph &store(const Key &key, const Glyph &glyph) {
+            if (glyph.region >= 0) {
+                const int page = atlas.region(glyph.region).page;
+                if (page >= static_cast<int>(pageUse.size())) {
+                    pageUse.resize(page + 1);
+                }
+                ++pageUse[page].glyphs;
+            }
+            return touch(glyphs.emplace(key, glyph).first->second);
+        }
+
+        void resetPage(const int page) {
+            for (auto it = glyphs.begin(); it != glyphs.end();) {
+                if (it->second.region >= 0 && atlas.region(it->second.region).page == page) {
+                    it = glyphs.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            atlas.resetPage(page);
+            pageUse[page].glyphs = 0;
+        }
+
+        // 这一段文字已经排进批次的字形所在的页不能动，都在用时返回 false
+        bool evict() {
+            int victim = -1;
+            for (int i = 0; i < static_cast<int>(pageUse.size()); ++i) {
+                if (pageUse[i].last != textSerial && (victim == -1 || pageUse[i].last < pageUse[victim].last)) {
+                    victim = i;
+                }
+            }
+            if (victim == -1) {
+                return false;
+            }
+            resetPage(victim);
+            return true;
+        }
+
+    public:
+        GlyphCache() : atlas(1024, 1) {
+        }
+
+        // 每段文字开始排版前调用，之后取到的字形所在的页在下一次调用前不会被清空
+        void beginText() {
+            ++textSerial;
+        }
+
+        const Glyph &get(const Font &font, const int code, const int size) {
+            const Key key{font.getID(), code, size};
+            const auto it = glyphs.find(key);
+            if (it != glyphs.end()) {
+                return touch(it->second);
+            }
+            Glyph glyph{-1, 0, 0, 0, 0};
+            font.makeBitmap(static_cast<wchar_t>(code), static_cast<float>(size), bitmap,
+                            glyph.x0, glyph.y0, glyph.w, glyph.h);
+            if (glyph.w > 0 && glyph.h > 0) {
+                glyph.region = insertAlpha(bitmap.data(), glyph.w, glyph.h);
+            }
+            return store(key, glyph);
+        }
+
+        const Glyph &getSDF(const Font &font, const int code) {
+            const Key key{font.getID(), code, 0};
+            const auto it = glyphs.find(key);
+            if (it != glyphs.end()) {
+                return touch(it->second);
+            }
+            Glyph glyph{-1, 0, 0, 0, 0};
+            const unsigned char *page;
+            int pitch;
+            if (const pack::Glyph *packed = font.bakedSDF(code, page, pitch)) {
+                glyph.x0 = packed->x0;
+                glyph.y0 = packed->y0;
+                glyph.w = packed->w;
+                glyph.h = packed->h;
+                if (glyph.w > 0 && glyph.h > 0) {
+                    bitmap.resize(static_cast<size_t>(glyph.w) * glyph.h);
+                    for (int row = 0; row < glyph.h; ++row) {
+                        memcpy(&bitmap[static_cast<size_t>(row) * glyph.w],
+                               page + static_cast<size_t>(packed->y + row) * pitch + packed->x, glyph.w);
+                    }
+                    glyph.region = insertAlpha(bitmap.data(), glyph.w, glyph.h);
+                }
+                return store(key, glyph);
+            }
+            unsigned char *sdf = font.makeSDF(code, SDF_SIZE, SDF_PADDING, SDF_ONEDGE, SDF_DIST_SCALE,
+                                              glyph.x0, glyph.y0, glyph.w, glyph.h);
+            if (sdf != nullptr) {
+                glyph.region = insertAlpha(sdf, glyph.w, glyph.h);
+                stbtt_FreeSDF(sdf, nullptr);
+            }
+            return store(key, glyph);
+        }
+
+        // 白色 + 单通道值作 alpha，普通字形用 SpriteBatch 的默认着色器就能着色
+        int insertAlpha(const unsigned char *alpha, const int w, const int h) {
+            const size_t count = static_cast<size_t>(w) * h;
+            rgba.resize(count * 4);
+            for (size_t i = 0; i < count; ++i) {
+                rgba[i * 4 + 0] = 255;
+                rgba[i * 4 + 1] = 255;
+                rgba[i * 4 + 2] = 255;
+                rgba[i * 4 + 3] = alpha[i];
+            }
+            int region = atlas.insert(rgba.data(), w, h, atlas.pageCount() < MAX_PAGES);
+            if (region < 0 && evict()) {
+                region = atlas.insert(rgba.data(), w, h, false);
+            }
+            if (region < 0) { // 这段文字用到的页都不能清，只好超出上限再开一页
+                region = atlas.insert(rgba.data(), w, h);
+            }
+            return region;
+        }
+
+        // 字体回收时去掉它的字形；一页上的字形全部作废时整页清空，空间马上可以复用
+        void forget(const unsigned int font) {
+            for (auto it = glyphs.begin(); it != glyphs.end();) {
+                if (it->first.font != font) {
+                    ++it;
+                    continue;
+                }
+                if (it->second.region >= 0) {
+                    --pageUse[atlas.region(it->second.region).page].glyphs;
+                }
+                it = glyphs.erase(it);
+            }
+            for (int i = 0; i < static_cast<int>(pageUse.size()); ++i) {
+                if (pageUse[i].glyphs == 0 && atlas.occupancy(i) > 0) {
+                    atlas.resetPage(i);
+                }
+            }
+        }
+
+        [[nodiscard]] const Atlas &getAtlas() const { return atlas; }
+    };
+
+    const char *sdfFsSrc = R"(
+        #version 330 core
+        uniform sampler2D texture0;
+        uniform vec4 sdfParams; // x: 描边宽度，y: 发光宽度，均为距离场单位
+        uniform vec4 outlineColor;
+        uniform vec4 glowColor;
+        varying vec2 uv;
+        varying vec4 tint;
+        void main() {
+            float d = texture2D(texture0, uv).a;
+            float aa = max(fwidth(d) * 0.5, 0.0001);
+            float fill = smoothstep(0.5 - aa, 0.5 + aa, d);
+            float edge = 0.5 - sdfParams.x;
+            float body = smoothstep(edge - aa, edge + aa, d);
+            vec4 color = mix(outlineColor, tint, fill);
+            color.a *= body;
+            float glow = sdfParams.y > 0.0 ? smoothstep(edge - sdfParams.y, edge, d) * glowColor.a : 0.0;
+            float a = color.a + glow * (1.0 - color.a);
+            vec3 rgb = (color.rgb * color.a + glowColor.rgb * glow * (1.0 - color.a)) / max(a, 0.0001);
+            gl_FragColor = vec4(rgb, a);
+        }
+    )";
+
+    GlyphCache *gGlyphCache;
+    SpriteBatch *gTextBatch; // drawText 共用的批次
+    Shader *gSDFShader;      // 距离场文字着色器，顶点部分与 SpriteBatch 共用
+
+    Font::~Font() {
+        if (gGlyphCache) {
+            gGlyphCache->forget(id);
+        }
+    }
+
+    float Font::drawText(const char *text, const float x, const float y, const float size,
+                         const float r, const float g, const float b, const float a, const SDFStyle *sdf) const {
+        // 距离场模式下字号不取整，字形从参考尺寸按 k 缩放
+        const int pixelSize = sdf ? GlyphCache::SDF_SIZE : static_cast<int>(size + 0.5f);
+        const float scale = scaleFor(sdf ? size : static_cast<float>(pixelSize));
+        const float k = sdf ? size / GlyphCache::SDF_SIZE : 1.0f;
+        float ascent, lineHeight;
+        verticalMetrics(scale, ascent, lineHeight);
+
+        gGlyphCache->beginText();
+        const Atlas &atlas = gGlyphCache->getAtlas();
+        float penX = x;
+        float baseline = y + ascent;
+        float width = 0;
+        int prev = 0;
+        if (sdf) {
+            // 屏幕像素 -> 距离场单位（参考尺寸下每像素 SDF_DIST_SCALE / 255）
+            const float unit = GlyphCache::SDF_DIST_SCALE / 255.0f / k;
+            const float reach = static_cast<float>(GlyphCache::SDF_PADDING) * k; // 字形四周留白，屏幕像素
+            const float outline = std::max(0.0f, std::min(sdf->outline, reach));
+            const float glow = std::max(0.0f, std::min(sdf->glow, reach - outline));
+            gSDFShader->use();
+            Shader::setVec4(gSDFShader->uniform("sdfParams"), outline * unit, glow * unit, 0.0f, 0.0f);
+            Shader::setVec4(gSDFShader->uniform("outlineColor"), sdf->outlineColor[0], sdf->outlineColor[1],
+                            sdf->outlineColor[2], sdf->outlineColor[3]);
+            Shader::setVec4(gSDFShader->uniform("glowColor"), sdf->glowColor[0], sdf->glowColor[1],
+                            sdf->glowColor[2], sdf->glowColor[3]);
+        }
+        gTextBatch->setShader(sdf ? gSDFShader : nullptr);
+        for (const char *p = text; *p;) {
+            const int code = decodeUTF8(p);
+            if (code == '\n') {
+                width = std::max(width, penX - x);
+                penX = x;
+                baseline += lineHeight;
+                prev = 0;
+                continue;
+            }
+            if (prev) {
+                penX += kern(prev, code, scale);
+            }
+            const auto &glyph = sdf ? gGlyphCache->getSDF(*this, code) : gGlyphCache->get(*this, code, pixelSize);
+            if (glyph.region >= 0) {
+                const auto &region = atlas.region(glyph.region);
+                gTextBatch->draw(atlas.page(region.page).getID(),
+                                 penX + static_cast<float>(glyph.x0) * k, baseline + static_cast<float>(glyph.y0) * k,
+                                 static_cast<float>(glyph.w) * k, static_cast<float>(glyph.h) * k,
+                                 region.u0, region.v0, region.u1, region.v1, r, g, b, a);
+            }
+            penX += advance(code, scale);
+            prev = code;
+        }
+        gTextBatch->flush();
+        return std::max(width, penX - x);
+    }
+
+    // 按资源路径（加上加载参数）去重的缓存。Lua 对象的 __gc 在用完时 release，
+    // 引用数归零的条目按最近最少使用排队，超过字节预算时才真正释放
+    class ResourceCache {
+    public:
+        enum Kind { TEXTURE, FONT };
+
+    private:
+        struct Entry {
+            Kind kind;
+            std::unique_ptr<Texture> texture;
+            std::unique_ptr<Font> font;
+            size_t cpuBytes = 0;
+            size_t gpuBytes = 0;
+            int refs = 0;
+            std::list<std::string>::iterator idle; // refs 为 0 时在 idleList 里的位置
+        };
+
+        std::unordered_map<std::string, Entry> entries;
+        std::unordered_map<const void *, std::string> owners; // 对象指针 -> 键
+        std::list<std::string> idleList; // 未被引用的条目，表头最久未用
+        size_t cpuBytes = 0;
+        size_t gpuBytes = 0;
+        size_t cpuBudget = 256u << 20;
+        size_t gpuBudget = 512u << 20;
+        long long hits = 0;
+        long long misses = 0;
+        long long evictions = 0;
+
+        static std::string makeKey(const Kind kind, const char *name, const char *params) {
+            static const char *prefix[] = {"texture:", "font:"};
+            std::string key = prefix[kind];
+            key += Zip::normalize(name);
+            if (params && *params) {
+                key += '?';
+                key += params;
+            }
+            return key;
+        }
+
+        // 命中时加引用并移出空闲队列
+        Entry *find(const std::string &key) {
+            const auto it = entries.find(key);
+            if (it == entries.end()) {
+                ++misses;
+                return nullptr;
+            }
+            ++hits;
+            Entry &entry = it->second;
+            if (entry.refs++ == 0) {
+                idleList.erase(entry.idle);
+            }
+            return &entry;
+        }
+
+        Entry &insert(const std::string &key, const Kind kind, const void *object, const size_t cpu,
+                      const size_t gpu) {
+            Entry &entry = entries[key];
+            entry.kind = kind;
+            entry.cpuBytes = cpu;
+            entry.gpuBytes = gpu;
+            entry.refs = 1;
+            owners[object] = key;
+            cpuBytes += cpu;
+            gpuBytes += gpu;
+            trim();
+            return entry;
+        }
+
+        void evict(const std::string &key) {
+            const auto it = entries.find(key);
+            Entry &entry = it->second;
+            cpuBytes -= entry.cpuBytes;
+            gpuBytes -= entry.gpuBytes;
+            owners.erase(entry.texture ? static_cast<const void *>(entry.texture.get())
+                                       : static_cast<const void *>(entry.font.get()));
+            entries.erase(it);
+            ++evictions;
+        }
+
+    public:
+        ResourceCache() = default;
+        ResourceCache(const ResourceCache &) = delete;
+        ResourceCache &operator=(const ResourceCache &) = delete;
+
+        Texture *acquireTexture(const char *name, const char *params = "") {
+            const std::string key = makeKey(TEXTURE, name, params);
+            if (Entry *entry = find(key)) {
+                return entry->texture.get();
+            }
+            auto texture = std::make_unique<Texture>(name);
+            return adoptTexture(key, std::move(texture));
+        }
+
+        // 异步加载完成的纹理交给缓存；同名纹理已经在缓存里时用已有的那份
+        Texture *adoptTexture(const char *name, std::unique_ptr<Texture> texture, const char *params = "") {
+            const std::string key = makeKey(TEXTURE, name, params);
+            if (Entry *entry = find(key)) {
+                return entry->texture.get();
+            }
+            return adoptTexture(key, std::move(texture));
+        }
+
+        Texture *adoptTexture(const std::string &key, std::unique_ptr<Texture> texture) {
+            const size_t bytes = static_cast<size_t>(texture->getWidth()) * texture->getHeight() * 4;
+            Texture *p = texture.get();
+            insert(key, TEXTURE, p, 0, bytes).texture = std::move(texture);
+            return p;
+        }
+
+        Font *acquireFont(const char *name) {
+            const std::string key = makeKey(FONT, name, "");
+            if (Entry *entry = find(key)) {
+                return entry->font.get();
+            }
+            return adoptFont(key, std::make_unique<Font>(name));
+        }
+
+        Font *adoptFont(const char *name, std::unique_ptr<Font> font) {
+            const std::string key = makeKey(FONT, name, "");
+            if (Entry *entry = find(key)) {
+                return entry->font.get();
+            }
+            return adoptFont(key, std::move(font));
+        }
+
+        Font *adoptFont(const std::string &key, std::unique_ptr<Font> font) {
+            Font *p = font.get();
+            insert(key, FONT, p, font->byteSize(), 0).font = std::move(font);
+            return p;
+        }
+
+        // 已经缓存时不增加引用，只返回对象；用于异步加载前先查一下
+        Texture *peekTexture(const char *name, const char *params = "") {
+            const auto it = entries.find(makeKey(TEXTURE, name, params));
+            return it == entries.end() ? nullptr : it->second.texture.get();
+        }
+
+        Font *peekFont(const char *name) {
+            const auto it = entries.find(makeKey(FONT, name, ""));
+            return it == entries.end() ? nullptr : it->second.font.get();
+        }
+
+        // 对象由缓存管理时减引用并返回 true，否则返回 false（调用方自己 delete）
+        bool release(const void *object) {
+            const auto owner = owners.find(object);
+            if (owner == owners.end()) {
+                return false;
+            }
+            Entry &entry = entries.find(owner->second)->second;
+            if (--entry.refs == 0) {
+                entry.idle = idleList.insert(idleList.end(), owner->second);
+                trim();
+            }
+            return true;
+        }
+
+        // 超出任一预算时从最久未用的空闲条目开始释放
+        void trim() {
+            while ((cpuBytes > cpuBudget || gpuBytes > gpuBudget) && !idleList.empty()) {
+                const std::string key = std::move(idleList.front());
+                idleList.pop_front();
+                evict(key);
+            }
+        }
+
+        void setBudget(const size_t cpu, const size_t gpu) {
+            cpuBudget = cpu;
+            gpuBudget = gpu;
+            trim();
+        }
+
+        void pushStats(lua_State *L) const {
+            lua_createtable(L, 0, 8);
+            lua_pushinteger(L, hits);
+            lua_setfield(L, -2, "hits");
+            lua_pushinteger(L, misses);
+            lua_setfield(L, -2, "misses");
+            lua_pushinteger(L, evictions);
+            lua_setfield(L, -2, "evictions");
+            lua_pushinteger(L, static_cast<lua_Integer>(entries.size()));
+            lua_setfield(L, -2, "entries");
+            lua_pushinteger(L, static_cast<lua_Integer>(idleList.size()));
+            lua_setfield(L, -2, "idle");
+            lua_pushinteger(L, static_cast<lua_Integer>(cpuBytes));
+            lua_setfield(L, -2, "cpuBytes");
+            lua_pushinteger(L, static_cast<lua_Integer>(gpuBytes));
+            lua_setfield(L, -2, "gpuBytes");
+            lua_pushinteger(L, static_cast<lua_Integer>(cpuBudget));
+            lua_setfield(L, -2, "cpuBudget");
+            lua_pushinteger(L, static_cast<lua_Integer>(gpuBudget));
+            lua_setfield(L, -2, "gpuBudget");
+        }
+    };
+
+    ResourceCache *gResources;
+
+    // 异步加载：工作线程负责读文件、解压和解码，解码好的 CPU 数据排队交回主线程，
+    // 主线程每帧在时间预算内做 GL 上传
+    class Loader {
+    public:
+        enum Kind { TEXTURE, FONT };
+
+        enum State { PENDING, DECODED, READY, FAILED };
+
+        struct Job {
+            Kind kind;
+            std::string name;
+            std::atomic<int> state{PENDING};
+            // 工作线程产出
+            stbi_uc *pixels = nullptr;
+            int w = 0;
+            int h = 0;
+            std::unique_ptr<Font> decodedFont;
+            // 主线程产出：交给 ResourceCache 后持有一份引用，被 Lua 取走前由 Job 负责释放
+            Texture *texture = nullptr;
+            Font *font = nullptr;
+            bool taken = false;
+
+            Job(const Kind kind, std::string name) : kind(kind), name(std::move(name)) {
+            }
+
+            ~Job() {
+                stbi_image_free(pixels);
+                // 工作线程处理完（成功或失败）都把自己那份引用交回 decoded 队列，不在本地留副本，
+                // 所以最后一份引用总在主线程上释放，这里可以放心动缓存和 GL 资源
+                if (!taken && gResources) {
+                    gResources->release(texture ? static_cast<const void *>(texture) : font);
+                }
+            }
+        };
+
+    private:
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wakeWorker;
+        std::condition_variable jobDecoded;
+        std::deque<std::shared_ptr<Job> > pending;
+        std::deque<std::shared_ptr<Job> > decoded;
+        bool quit = false;
+        double budgetMs = 4.0;
+
+        void run() {
+            for (;;) {
+                std::shared_ptr<Job> job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wakeWorker.wait(lock, [this] { return quit || !pending.empty(); });
+                    if (quit) {
+                        return;
+                    }
+                    job = std::move(pending.front());
+                    pending.pop_front();
+                }
+                bool ok = false;
+                if (job->kind == TEXTURE) {
+                    // 资源包里的纹理不用解码，留给主线程直接上传
+                    ok = findPacked(job->name.c_str(), pack::TEXTURE) != nullptr;
+                    if (!ok) {
+                        job->pixels = loadImage(job->name.c_str(), job->w, job->h);
+                        ok = job->pixels != nullptr;
+                    }
+                } else {
+                    std::vector<unsigned char> data;
+                    if (readFile(job->name.c_str(), data)) {
+                        job->decodedFont = std::make_unique<Font>(std::move(data), job->name.c_str());
+                        ok = true;
+                    }
+                }
+                if (!ok) {
+                    printf("[ERROR] failed to load %s\n", job->name.c_str());
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    job->state = ok ? DECODED : FAILED;
+                    decoded.push_back(std::move(job)); // 失败的也交回去，由主线程丢弃
+                }
+                jobDecoded.notify_all();
+            }
+        }
+
+        // 只在主线程调用
+        static void finish(Job &job) {
+            if (job.kind == TEXTURE) {
+                // 没有像素说明是资源包里的纹理，按名字直接上传
+                auto texture = job.pixels ? std::make_unique<Texture>(job.w, job.h, job.pixels)
+                                          : std::make_unique<Texture>(job.name.c_str());
+                job.texture = gResources->adoptTexture(job.name.c_str(), std::move(texture));
+                stbi_image_free(job.pixels);
+                job.pixels = nullptr;
+            } else {
+                job.font = gResources->adoptFont(job.name.c_str(), std::move(job.decodedFont));
+            }
+            job.state = READY;
+        }
+
+    public:
+        explicit Loader(const int threads = 2) {
+            for (int i = 0; i < (threads < 1 ? 1 : threads); ++i) {
+                workers.emplace_back([this] { run(); });
+            }
+        }
+
+        ~Loader() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                quit = true;
+            }
+            wakeWorker.notify_all();
+            for (auto &worker: workers) {
+                worker.join();
+            }
+        }
+
+        void setBudget(const double ms) { budgetMs = ms; }
+
+        std::shared_ptr<Job> request(const Kind kind, const char *name) {
+            auto job = std::make_shared<Job>(kind, name);
+            // 已经在缓存里的资源不必再排队
+            if (kind == TEXTURE ? gResources->peekTexture(name) != nullptr : gResources->peekFont(name) != nullptr) {
+                if (kind == TEXTURE) {
+                    job->texture = gResources->acquireTexture(name);
+                } else {
+                    job->font = gResources->acquireFont(name);
+                }
+                job->state = READY;
+                return job;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending.push_back(job);
+            }
+            wakeWorker.notify_one();
+            return job;
+        }
+
+        // 每帧调用：上传解码好的资源，超出预算就留到下一帧，但每帧至少处理一个
+        void pump() {
+            const Uint64 start = SDL_GetPerformanceCounter();
+            const double frequency = static_cast<double>(SDL_GetPerformanceFrequency());
+            for (;;) {
+                std::shared_ptr<Job> job;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (decoded.empty()) {
+                        return;
+                    }
+                    job = std::move(decoded.front());
+                    decoded.pop_front();
+                }
+                if (job->state != DECODED) {
+                    continue; // 失败的只是在主线程上放掉引用
+                }
+                finish(*job);
+                const double elapsed = static_cast<double>(SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+                if (elapsed >= budgetMs) {
+                    return;
+                }
+            }
+        }
+
+        // 阻塞到这个任务完成，立刻上传，不等 pump
+        void wait(const std::shared_ptr<Job> &job) {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobDecoded.wait(lock, [&job] { return job->state != PENDING; });
+            const auto it = std::find(decoded.begin(), decoded.end(), job);
+            if (it != decoded.end()) { // 失败的可能已经被 pump 取走
+                decoded.erase(it);
+            }
+            if (job->state == DECODED) {
+                lock.unlock();
+                finish(*job);
+            }
+        }
+    };
+
+    Loader *gLoader;
+
+    struct AssetFuture {
+        std::shared_ptr<Loader::Job> job;
+    };
+
+    // 用 stb_vorbis 的 pushdata 接口边读边解码。已经在内存里的数据（资源包、映射的存储条目）直接喂指针；
+    // 磁盘文件和压缩条目按块读进一小段缓冲，不再把整个文件读出来或解压出来
+    class VorbisStream {
+        static constexpr size_t CHUNK = 16 << 10;
+
+        std::string name;
+        // 数据来源，同时只有一个有效
+        const unsigned char *memory = nullptr;
+        size_t memorySize = 0;
+        Zip::Blob view;
+        FILE *file = nullptr;
+        std::unique_ptr<Zip::Stream> zipStream;
+
+        std::vector<unsigned char> buffer; // 流式来源读进来的压缩数据，[begin, end) 还没喂给解码器
+        size_t begin = 0;
+        size_t end = 0;
+
+        stb_vorbis *vorbis = nullptr;
+        int channels = 0;
+        int rate = 0;
+        float **outputs = nullptr; // 当前帧的各声道输出，归 stb_vorbis 所有
+        int outputCount = 0;
+        int outputPos = 0;
+        int position = 0; // 已经读出（或跳过）的帧数
+
+        bool openSource() {
+            if (const pack::Entry *entry = findPacked(name.c_str(), pack::RAW)) {
+                memory = gPack->data(*entry);
+                memorySize = entry->size;
+                return true;
+            }
+            file = fopen(name.c_str(), "rb");
+            if (file != nullptr) {
+                return true;
+            }
+            view = gZip->view(name.c_str());
+            if (view) {
+                memory = view.data();
+                memorySize = view.size();
+                return true;
+            }
+            zipStream = gZip->stream(name.c_str());
+            return zipStream != nullptr;
+        }
+
+        void closeSource() {
+            memory = nullptr;
+            memorySize = 0;
+            view.release();
+            if (file) {
+                fclose(file);
+                file = nullptr;
+            }
+            zipStream.reset();
+            begin = end = 0;
+        }
+
+        [[nodiscard]] const unsigned char *window(size_t &size) const {
+            if (memory) {
+                size = memorySize - begin;
+                return memory + begin;
+            }
+            size = end - begin;
+            return buffer.data() + begin;
+        }
+
+        // 再读一块进缓冲，数据已经读完时返回 false
+        bool fill() {
+            if (memory) {
+                return false;
+            }
+            if (begin > 0) {
+                memmove(buffer.data(), buffer.data() + begin, end - begin);
+                end -= begin;
+                begin = 0;
+            }
+            if (end == buffer.size()) {
+                // 缓冲里是一整块还不够解码的数据（比如很大的头），只能加大
+                buffer.resize(buffer.empty() ? CHUNK : buffer.size() * 2);
+            }
+            const size_t want = buffer.size() - end;
+            const size_t got = file ? fread(buffer.data() + end, 1, want, file)
+                                    : zipStream->read(buffer.data() + end, want);
+            end += got;
+            return got > 0;
+        }
+
+        bool start() {
+            if (!openSource()) {
+                return false;
+            }
+            for (;;) {
+                size_t size;
+                const unsigned char *data = window(size);
+                int used = 0;
+                int error = 0;
+                vorbis = stb_vorbis_open_pushdata(data, static_cast<int>(size), &used, &error, nullptr);
+                if (vorbis) {
+                    begin += used;
+                    break;
+                }
+                if (error != VORBIS_need_more_data || !fill()) {
+                    return false;
+                }
+            }
+            const stb_vorbis_info info = stb_vorbis_get_info(vorbis);
+            channels = info.channels;
+            rate = static_cast<int>(info.sample_rate);
+            return true;
+        }
+
+        void stop() {
+            if (vorbis) {
+                stb_vorbis_close(vorbis);
+                vorbis = nullptr;
+            }
+            closeSource();
+            outputs = nullptr;
+            outputCount = outputPos = 0;
+            position = 0;
+        }
+
+        bool decodeFrame() {
+            for (;;) {
+                size_t size;
+                const unsigned char *data = window(size);
+                int frameChannels = 0;
+                int samples = 0;
+                const int used = stb_vorbis_decode_frame_pushdata(vorbis, data, static_cast<int>(size), &frameChannels,
+                                                                  &outputs, &samples);
+                begin += used;
+                if (samples > 0) {
+                    outputCount = samples;
+                    outputPos = 0;
+                    return true;
+                }
+                if (used == 0 && !fill()) {
+                    return false;
+                }
+            }
+        }
+
+        static short toShort(const float v) {
+            const int sample = static_cast<int>(v * 32767.0f);
+            return static_cast<short>(sample > 32767 ? 32767 : sample < -32768 ? -32768 : sample);
+        }
+
+    public:
+        explicit VorbisStream(const char *name) : name(name) {
+            if (!start()) {
+                stop();
+            }
+        }
+
+        ~VorbisStream() {
+            stop();
+        }
+
+        VorbisStream(const VorbisStream &) = delete;
+        VorbisStream &operator=(const VorbisStream &) = delete;
+
+        [[nodiscard]] bool valid() const { return vorbis != nullptr; }
+
+        [[nodiscard]] int sampleRate() const { return rate; }
+
+        // 解出最多 frames 帧交错的双声道 s16，单声道复制到两边；返回实际帧数，不足说明到了结尾
+        int read(short *out, const int frames) {
+            int written = 0;
+            while (vorbis && written < frames) {
+                if (outputPos == outputCount && !decodeFrame()) {
+                    break;
+                }
+                const int n = std::min(frames - written, outputCount - outputPos);
+                const float *left = outputs[0] + outputPos;
+                const float *right = outputs[channels > 1 ? 1 : 0] + outputPos;
+                for (int i = 0; i < n; ++i) {
+                    out[(written + i) * 2 + 0] = toShort(left[i]);
+                    out[(written + i) * 2 + 1] = toShort(right[i]);
+                }
+                written += n;
+                outputPos += n;
+            }
+            position += written;
+            return written;
+        }
+
+        // 当前解到第几帧；跳转越过结尾时就是整个文件的帧数
+        [[nodiscard]] int tell() const { return position; }
+
+        // pushdata 模式不能 seek，循环播放时从头重新打开
+        bool rewind() {
+            stop();
+            return start();
+        }
+
+        // 同理，跳转是从头解码并丢掉前 frame 帧
+        bool seek(const int frame) {
+            if (!rewind()) {
+                return false;
+            }
+            int skipped = 0;
+            while (skipped < frame) {
+                if (outputPos == outputCount && !decodeFrame()) {
+                    position = skipped;
+                    return false;
+                }
+                const int n = std::min(frame - skipped, outputCount - outputPos);
+                skipped += n;
+                outputPos += n;
+            }
+            position = skipped;
+            return true;
+        }
+    };
+
+    // 短音效一次解成 PCM 常驻内存，多个通道各拿指针和游标播放，不再重复解码；长的仍然交给 VorbisStream 流式解。
+    // 解码线程 get 到的片段在同一线程 release 之前不会被淘汰，混音回调可以直接持有指针；
+    // 总量超过 maxBytes 时按最久没用的顺序淘汰没人在放的片段
+    class SampleBank {
+    public:
+        struct Sample {
+            std::vector<short> pcm; // 交错的双声道
+            int frames = 0;
+            int rate = 0; // 文件本身的采样率，混音时再转换
+        };
+
+        struct Stats {
+            int clips = 0;
+            int streamed = 0; // 超过长度、改为流式的文件数
+            size_t bytes = 0;
+            size_t maxBytes = 0;
+            long long hits = 0;
+            long long misses = 0;
+            long long evictions = 0;
+            double maxSeconds = 0;
+        };
+
+    private:
+        // Vorbis 最高质量也不到 640 kbit/s，再给头（注释、封面）留 64 KB：
+        // 比这个还大的文件一定超过时长上限，不用读进来就能判为流式
+        static constexpr size_t MAX_BYTES_PER_SECOND = 80 << 10;
+        static constexpr size_t HEADER_SLACK = 64 << 10;
+
+        struct Entry {
+            std::unique_ptr<const Sample> sample; // 空指针表示流式播放
+            int users = 0; // 正在放它的通道数
+            unsigned long long lastUse = 0;
+        };
+
+        std::mutex mutex; // 解码线程查询、游戏线程取统计和改上限
+        std::unordered_map<std::string, Entry> samples;
+        double maxSeconds;
+        size_t maxBytes;
+        size_t bytes = 0;
+        unsigned long long useSerial = 0;
+        Stats counters;
+
+        static size_t sizeOf(const Sample &sample) {
+            return sample.pcm.size() * sizeof(short);
+        }
+
+        static std::unique_ptr<const Sample> decode(const char *name, const double maxSeconds) {
+            size_t stored = 0;
+            if (!fileSize(name, stored) ||
+                stored > static_cast<size_t>(maxSeconds * MAX_BYTES_PER_SECOND) + HEADER_SLACK) {
+                return nullptr;
+            }
+            std::vector<unsigned char> data;
+            if (!readFile(name, data)) {
+                return nullptr;
+            }
+            // 先只读头和总长，长音乐不必整段解出来
+            int error = 0;
+            stb_vorbis *vorbis = stb_vorbis_open_memory(data.data(), static_cast<int>(data.size()), &error, nullptr);
+            if (vorbis == nullptr) {
+                return nullptr;
+            }
+            const unsigned int length = stb_vorbis_stream_length_in_samples(vorbis);
+            const unsigned int fileRate = stb_vorbis_get_info(vorbis).sample_rate;
+            stb_vorbis_close(vorbis);
+            if (length == 0 || length > maxSeconds * fileRate) {
+                return nullptr;
+            }
+            int channels = 0;
+            int rate = 0;
+            short *output = nullptr;
+            const int frames = stb_vorbis_decode_memory(data.data(), static_cast<int>(data.size()), &channels, &rate,
+                                                        &output);
+            if (frames <= 0) {
+                return nullptr;
+            }
+            // 和 VorbisStream::read 一致：单声道复制到两边，多余的声道丢掉
+            auto sample = std::make_unique<Sample>();
+            sample->frames = frames;
+            sample->rate = rate;
+            sample->pcm.resize(static_cast<size_t>(frames) * 2);
+            for (int i = 0; i < frames; ++i) {
+                sample->pcm[i * 2 + 0] = output[i * channels];
+                sample->pcm[i * 2 + 1] = output[i * channels + (channels > 1 ? 1 : 0)];
+            }
+            free(output);
+            return sample;
+        }
+
+        // 持锁调用。每次淘汰一个最久没用的，直到不超过上限或者剩下的都有人在放
+        void evict() {
+            while (bytes > maxBytes) {
+                auto victim = samples.end();
+                for (auto it = samples.begin(); it != samples.end(); ++it) {
+                    if (it->second.sample && it->second.users == 0 &&
+                        (victim == samples.end() || it->second.lastUse < victim->second.lastUse)) {
+                        victim = it;
+                    }
+                }
+                if (victim == samples.end()) {
+                    return;
+                }
+                bytes -= sizeOf(*victim->second.sample);
+                samples.erase(victim);
+                ++counters.evictions;
+            }
+        }
+
+    public:
+        explicit SampleBank(const double maxSeconds = 2.0, const size_t maxBytes = 64 << 20)
+            : maxSeconds(maxSeconds), maxBytes(maxBytes) {}
+
+        SampleBank(const SampleBank &) = delete;
+        SampleBank &operator=(const SampleBank &) = delete;
+
+        // 解码线程调用：短片段返回解好的 PCM，长的或解不了的返回 nullptr，由调用方改走流式。
+        // 返回非空时通道放完要用同一个名字 release
+        const Sample *get(const char *name) {
+            const std::string key = Zip::normalize(name);
+            double limit;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                const auto it = samples.find(key);
+                if (it != samples.end()) {
+                    ++counters.hits;
+                    if (it->second.sample) {
+                        ++it->second.users;
+                        it->second.lastUse = ++useSerial;
+                    }
+                    return it->second.sample.get();
+                }
+                ++counters.misses;
+                limit = maxSeconds;
+            }
+            // 解码不持锁，只有一个解码线程，不会重复解同一个文件
+            std::unique_ptr<const Sample> sample = decode(name, limit);
+            std::lock_guard<std::mutex> lock(mutex);
+            Entry &entry = samples[key];
+            entry.sample = std::move(sample);
+            if (entry.sample) {
+                entry.users = 1;
+                entry.lastUse = ++useSerial;
+                bytes += sizeOf(*entry.sample);
+                evict();
+            }
+            return entry.sample.get();
+        }
+
+        // 解码线程回收通道时调用，之后这个片段可以被淘汰
+        void release(const char *name) {
+            std::lock_guard<std::mutex> lock(mutex);
+            const auto it = samples.find(Zip::normalize(name));
+            if (it != samples.end() && it->second.users > 0) {
+                --it->second.users;
+                evict();
+            }
+        }
+
+        // 只影响之后第一次播放的文件；已经判为流式的重新判断，已经解好的保留
+        void setMaxSeconds(const double seconds) {
+            std::lock_guard<std::mutex> lock(mutex);
+            maxSeconds = std::max(0.0, seconds);
+            for (auto it = samples.begin(); it != samples.end();) {
+                it = it->second.sample ? std::next(it) : samples.erase(it);
+            }
+        }
+
+        void setMaxBytes(const size_t limit) {
+            std::lock_guard<std::mutex> lock(mutex);
+            maxBytes = limit;
+            evict();
+        }
+
+        Stats stats() {
+            std::lock_guard<std::mutex> lock(mutex);
+            Stats result = counters;
+            result.maxSeconds = maxSeconds;
+            result.maxBytes = maxBytes;
+            result.bytes = bytes;
+            for (const auto &it: samples) {
+                if (it.second.sample) {
+                    ++result.clips;
+                } else {
+                    ++result.streamed;
+                }
+            }
+            return result;
+        }
+    };
+
+    // 混音内核：各通道先转成 float，按每帧线性变化的左右增益累加进 float 缓冲，最后一次性钳位取整成 s16。
+    // 变调或采样率和设备不同的通道用 4 点 Catmull-Rom 三次插值重采样。各实现运算顺序相同，输出逐位一致
+    struct MixGain {
+        float left;
+        float right;
+        float leftStep; // 每帧的增量，音量和声像变化时在一块里渐变，避免咔嗒声
+        float rightStep;
+    };
+
+    // 交错双声道 s16 转成 float，自动向量化就够了
+    void toFloat(float *out, const short *src, const size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = static_cast<float>(src[i]);
+        }
+    }
+
+    inline float cubic(const float xm1, const float x0, const float x1, const float x2, const float t) {
+        const float a = x1 - xm1;
+        const float b = 2.0f * xm1 - 5.0f * x0 + 4.0f * x1 - x2;
+        const float c = 3.0f * (x0 - x1) + x2 - xm1;
+        return x0 + 0.5f * t * (a + t * (b + t * c));
+    }
+
+    // acc 第 k 帧 += src 第 k 帧 * 增益，k 从 begin 到 end
+    void accumulateFrom(float *acc, const float *src, const MixGain &gain, const size_t begin, const size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            const auto f = static_cast<float>(k);
+            acc[k * 2 + 0] += src[k * 2 + 0] * (gain.left + gain.leftStep * f);
+            acc[k * 2 + 1] += src[k * 2 + 1] * (gain.right + gain.rightStep * f);
+        }
+    }
+
+    // src 开头多放一帧历史：输出第 k 帧取 src 里 phase + step * k 之后的第 1、2 帧之间插值，
+    // 用到 floor 位置起的 4 帧
+    void resampleFrom(float *acc, const float *src, const double phase, const double step, const MixGain &gain,
+                      const size_t begin, const size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            const double pos = phase + step * static_cast<double>(k);
+            const auto i = static_cast<size_t>(pos);
+            const auto t = static_cast<float>(pos - static_cast<double>(i));
+            const float *x = src + i * 2;
+            const auto f = static_cast<float>(k);
+            acc[k * 2 + 0] += cubic(x[0], x[2], x[4], x[6], t) * (gain.left + gain.leftStep * f);
+            acc[k * 2 + 1] += cubic(x[1], x[3], x[5], x[7], t) * (gain.right + gain.rightStep * f);
+        }
+    }
+
+    void saturateFrom(short *out, const float *acc, const size_t begin, const size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            // 和 cvtps2dq 一样按默认的四舍六入五成双取整
+            out[i] = static_cast<short>(lrintf(std::min(std::max(acc[i], -32768.0f), 32767.0f)));
+        }
+    }
+
+    void accumulateScalar(float *acc, const float *src, const MixGain &gain, const size_t frames) {
+        accumulateFrom(acc, src, gain, 0, frames);
+    }
+
+    void resampleScalar(float *acc, const float *src, const double phase, const double step, const MixGain &gain,
+                        const size_t frames) {
+        resampleFrom(acc, src, phase, step, gain, 0, frames);
+    }
+
+    void saturateScalar(short *out, const float *acc, const size_t n) {
+        saturateFrom(out, acc, 0, n);
+    }
+
+#ifdef MIX_SSE2
+    // 一个 __m128 放两帧：L R L R
+    void accumulateSSE2(float *acc, const float *src, const MixGain &gain, const size_t frames) {
+        const __m128 base = _mm_setr_ps(gain.left, gain.right, gain.left, gain.right);
+        const __m128 slope = _mm_setr_ps(gain.leftStep, gain.rightStep, gain.leftStep, gain.rightStep);
+        size_t k = 0;
+        for (; k + 2 <= frames; k += 2) {
+            const auto f0 = static_cast<float>(k);
+            const auto f1 = static_cast<float>(k + 1);
+            const __m128 g = _mm_add_ps(base, _mm_mul_ps(slope, _mm_setr_ps(f0, f0, f1, f1)));
+            const __m128 x = _mm_mul_ps(_mm_loadu_ps(src + k * 2), g);
+            _mm_storeu_ps(acc + k * 2, _mm_add_ps(_mm_loadu_ps(acc + k * 2), x));
+        }
+        accumulateFrom(acc, src, gain, k, frames);
+    }
+
+    // 两个输出帧各自的 4 个输入帧是连续的 8 个 float，拼成 xm1/x0/x1/x2 四个向量一起算多项式
+    inline __m128 cubicSSE2(const float *src, const double phase, const double step, const size_t k) {
+        const double p0 = phase + step * static_cast<double>(k);
+        const double p1 = phase + step * static_cast<double>(k + 1);
+        const auto i0 = static_cast<size_t>(p0);
+        const auto i1 = static_cast<size_t>(p1);
+        const auto t0 = static_cast<float>(p0 - static_cast<double>(i0));
+        const auto t1 = static_cast<float>(p1 - static_cast<double>(i1));
+        const __m128 a0 = _mm_loadu_ps(src + i0 * 2);
+        const __m128 b0 = _mm_loadu_ps(src + i0 * 2 + 4);
+        const __m128 a1 = _mm_loadu_ps(src + i1 * 2);
+        const __m128 b1 = _mm_loadu_ps(src + i1 * 2 + 4);
+        const __m128 xm1 = _mm_movelh_ps(a0, a1);
+        const __m128 x0 = _mm_movehl_ps(a1, a0);
+        const __m128 x1 = _mm_movelh_ps(b0, b1);
+        const __m128 x2 = _mm_movehl_ps(b1, b0);
+        const __m128 t = _mm_setr_ps(t0, t0, t1, t1);
+        const __m128 a = _mm_sub_ps(x1, xm1);
+        const __m128 b = _mm_sub_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(2.0f), xm1),
+                                                          _mm_mul_ps(_mm_set1_ps(5.0f), x0)),
+                                               _mm_mul_ps(_mm_set1_ps(4.0f), x1)), x2);
+        const __m128 c = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(3.0f), _mm_sub_ps(x0, x1)), x2), xm1);
+        const __m128 poly = _mm_add_ps(a, _mm_mul_ps(t, _mm_add_ps(b, _mm_mul_ps(t, c))));
+        return _mm_add_ps(x0, _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), t), poly));
+    }
+
+    void resampleSSE2(float *acc, const float *src, const double phase, const double step, const MixGain &gain,
+                      const size_t frames) {
+        const __m128 base = _mm_setr_ps(gain.left, gain.right, gain.left, gain.right);
+        const __m128 slope = _mm_setr_ps(gain.leftStep, gain.rightStep, gain.leftStep, gain.rightStep);
+        size_t k = 0;
+        for (; k + 2 <= frames; k += 2) {
+            const auto f0 = static_cast<float>(k);
+            const auto f1 = static_cast<float>(k + 1);
+            const __m128 g = _mm_add_ps(base, _mm_mul_ps(slope, _mm_setr_ps(f0, f0, f1, f1)));
+            const __m128 y = _mm_mul_ps(cubicSSE2(src, phase, step, k), g);
+            _mm_storeu_ps(acc + k * 2, _mm_add_ps(_mm_loadu_ps(acc + k * 2), y));
+        }
+        resampleFrom(acc, src, phase, step, gain, k, frames);
+    }
+
+    void saturateSSE2(short *out, const float *acc, const size_t n) {
+        const __m128 lo = _mm_set1_ps(-32768.0f);
+        const __m128 hi = _mm_set1_ps(32767.0f);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            const __m128i a0 = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(acc + i), lo), hi));
+            const __m128i a1 = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(acc + i + 4), lo), hi));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packs_epi32(a0, a1));
+        }
+        saturateFrom(out, acc, i, n);
+    }
+#endif
+
+#ifdef MIX_AVX2
+    // 一个 __m256 放四帧；不用 FMA，保持和标量版本相同的舍入
+    __attribute__((target("avx2")))
+    void accumulateAVX2(float *acc, const float *src, const MixGain &gain, const size_t frames) {
+        const __m256 base = _mm256_setr_ps(gain.left, gain.right, gain.left, gain.right,
+                                           gain.left, gain.right, gain.left, gain.right);
+        const __m256 slope = _mm256_setr_ps(gain.leftStep, gain.rightStep, gain.leftStep, gain.rightStep,
+                                            gain.leftStep, gain.rightStep, gain.leftStep, gain.rightStep);
+        size_t k = 0;
+        for (; k + 4 <= frames; k += 4) {
+            const auto f0 = static_cast<float>(k);
+            const auto f1 = static_cast<float>(k + 1);
+            const auto f2 = static_cast<float>(k + 2);
+            const auto f3 = static_cast<float>(k + 3);
+            const __m256 g = _mm256_add_ps(base, _mm256_mul_ps(slope, _mm256_setr_ps(f0, f0, f1, f1, f2, f2, f3, f3)));
+            const __m256 x = _mm256_mul_ps(_mm256_loadu_ps(src + k * 2), g);
+            _mm256_storeu_ps(acc + k * 2, _mm256_add_ps(_mm256_loadu_ps(acc + k * 2), x));
+        }
+        accumulateFrom(acc, src, gain, k, frames);
+    }
+
+    // 取输入帧和 SSE2 版本一样，两对拼成一个 __m256 再算多项式
+    __attribute__((target("avx2")))
+    void resampleAVX2(float *acc, const float *src, const double phase, const double step, const MixGain &gain,
+                      const size_t frames) {
+        const __m256 base = _mm256_setr_ps(gain.left, gain.right, gain.left, gain.right,
+                                           gain.left, gain.right, gain.left, gain.right);
+        const __m256 slope = _mm256_setr_ps(gain.leftStep, gain.rightStep, gain.leftStep, gain.rightStep,
+                                            gain.leftStep, gain.rightStep, gain.leftStep, gain.rightStep);
+        size_t k = 0;
+        for (; k + 4 <= frames; k += 4) {
+            __m256 xm1, x0, x1, x2, t;
+            float ts[8];
+            __m128 taps[2][4];
+            for (int h = 0; h < 2; ++h) {
+                const size_t j = k + h * 2;
+                const double p0 = phase + step * static_cast<double>(j);
+                const double p1 = phase + step * static_cast<double>(j + 1);
+                const auto i0 = static_cast<size_t>(p0);
+                const auto i1 = static_cast<size_t>(p1);
+                ts[h * 4 + 0] = ts[h * 4 + 1] = static_cast<float>(p0 - static_cast<double>(i0));
+                ts[h * 4 + 2] = ts[h * 4 + 3] = static_cast<float>(p1 - static_cast<double>(i1));
+                const __m128 a0 = _mm_loadu_ps(src + i0 * 2);
+                const __m128 b0 = _mm_loadu_ps(src + i0 * 2 + 4);
+                const __m128 a1 = _mm_loadu_ps(src + i1 * 2);
+                const __m128 b1 = _mm_loadu_ps(src + i1 * 2 + 4);
+                taps[h][0] = _mm_movelh_ps(a0, a1);
+                taps[h][1] = _mm_movehl_ps(a1, a0);
+                taps[h][2] = _mm_movelh_ps(b0, b1);
+                taps[h][3] = _mm_movehl_ps(b1, b0);
+            }
+            xm1 = _mm256_insertf128_ps(_mm256_castps128_ps256(taps[0][0]), taps[1][0], 1);
+            x0 = _mm256_insertf128_ps(_mm256_castps128_ps256(taps[0][1]), taps[1][1], 1);
+            x1 = _mm256_insertf128_ps(_mm256_castps128_ps256(taps[0][2]), taps[1][2], 1);
+            x2 = _mm256_insertf128_ps(_mm256_castps128_ps256(taps[0][3]), taps[1][3], 1);
+            t = _mm256_loadu_ps(ts);
+            const __m256 a = _mm256_sub_ps(x1, xm1);
+            const __m256 b = _mm256_sub_ps(_mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(2.0f), xm1),
+                                                                       _mm256_mul_ps(_mm256_set1_ps(5.0f), x0)),
+                                                         _mm256_mul_ps(_mm256_set1_ps(4.0f), x1)), x2);
+            const __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(3.0f), _mm256_sub_ps(x0, x1)),
+                                                         x2), xm1);
+            const __m256 poly = _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_add_ps(b, _mm256_mul_ps(t, c))));
+            const __m256 y = _mm256_add_ps(x0, _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), t), poly));
+            const auto f0 = static_cast<float>(k);
+            const auto f1 = static_cast<float>(k + 1);
+            const auto f2 = static_cast<float>(k + 2);
+            const auto f3 = static_cast<float>(k + 3);
+            const __m256 g = _mm256_add_ps(base, _mm256_mul_ps(slope, _mm256_setr_ps(f0, f0, f1, f1, f2, f2, f3, f3)));
+            _mm256_storeu_ps(acc + k * 2, _mm256_add_ps(_mm256_loadu_ps(acc + k * 2), _mm256_mul_ps(y, g)));
+        }
+        resampleFrom(acc, src, phase, step, gain, k, frames);
+    }
+
+    __attribute__((target("avx2")))
+    void saturateAVX2(short *out, const float *acc, const size_t n) {
+        const __m256 lo = _mm256_set1_ps(-32768.0f);
+        const __m256 hi = _mm256_set1_ps(32767.0f);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            const __m256i a0 = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(acc + i), lo), hi));
+            const __m256i a1 = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(acc + i + 8), lo), hi));
+            // packs 在每个 128 位通道内交错，再按 64 位重排回顺序
+            const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a0, a1), 0xD8);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), packed);
+        }
+        saturateFrom(out, acc, i, n);
+    }
+#endif
+
+    struct MixKernel {
+        const char *name;
+        // 采样率相同且不变调时的快速路径
+        void (*accumulate)(float *acc, const float *src, const MixGain &gain, size_t frames);
+        void (*resample)(float *acc, const float *src, double phase, double step, const MixGain &gain, size_t frames);
+        void (*saturate)(short *out, const float *acc, size_t n);
+    };
+
+    // 按从快到慢排列，第一个可用的就是默认内核
+    std::vector<MixKernel> availableMixKernels() {
+        std::vector<MixKernel> kernels;
+#ifdef MIX_AVX2
+        if (__builtin_cpu_supports("avx2")) {
+            kernels.push_back({"avx2", accumulateAVX2, resampleAVX2, saturateAVX2});
+        }
+#endif
+#ifdef MIX_SSE2
+        kernels.push_back({"sse2", accumulateSSE2, resampleSSE2, saturateSSE2});
+#endif
+        kernels.push_back({"scalar", accumulateScalar, resampleScalar, saturateScalar});
+        return kernels;
+    }
+
+    const MixKernel &mixKernel() {
+        static const MixKernel kernel = availableMixKernels().front();
+        return kernel;
+    }
+
+    // 总线上的效果，处理交错双声道 float。状态和参数只在混音回调里改，缓冲在总线启用前由游戏线程分配好
+    enum EffectType {
+        EFFECT_HIGHPASS = 0,
+        EFFECT_LOWPASS = 1,
+        EFFECT_DELAY = 2,
+        EFFECT_REVERB = 3,
+        EFFECT_COUNT = 4,
+    };
+
+    // 低于这个量级的滤波状态直接清零，免得衰减到非规格化数时变慢
+    inline float flushDenormal(const float v) {
+        return std::fabs(v) < 1e-15f ? 0.0f : v;
+    }
+
+    // 混音期间打开 FTZ/DAZ：延迟线和梳状滤波的缓冲衰减到非规格化数时也不会变慢。
+    // 离开作用域就恢复，离线渲染跑在调用线程上，不能改掉它的浮点模式
+    struct DenormalGuard {
+#ifdef MIX_SSE2
+        const unsigned int saved = _mm_getcsr();
+
+        DenormalGuard() {
+            _mm_setcsr(saved | 0x8040); // FTZ | DAZ
+        }
+
+        ~DenormalGuard() {
+            _mm_setcsr(saved);
+        }
+#else
+        DenormalGuard() = default;
+#endif
+        DenormalGuard(const DenormalGuard &) = delete;
+        DenormalGuard &operator=(const DenormalGuard &) = delete;
+    };
+
+    // 转置直接 II 型双二阶滤波，系数按 RBJ cookbook 算，左右声道各一套状态
+    struct Biquad {
+        bool enabled = false;
+        float b0 = 1.0f, b1 = 0, b2 = 0, a1 = 0, a2 = 0;
+        float z1[2] = {};
+        float z2[2] = {};
+
+        void design(const EffectType type, const double cutoff, const double q, const int rate) {
+            const double w = 2.0 * M_PI * std::max(10.0, std::min(cutoff, rate * 0.49)) / rate;
+            const double alpha = std::sin(w) / (2.0 * std::max(0.1, q));
+            const double c = std::cos(w);
+            const double a0 = 1.0 + alpha;
+            const double k = (type == EFFECT_LOWPASS ? 1.0 - c : 1.0 + c) / 2.0;
+            b0 = static_cast<float>(k / a0);
+            b1 = static_cast<float>((type == EFFECT_LOWPASS ? 2.0 * k : -2.0 * k) / a0);
+            b2 = b0;
+            a1 = static_cast<float>(-2.0 * c / a0);
+            a2 = static_cast<float>((1.0 - alpha) / a0);
+        }
+    };
+
+    // 反馈延迟：输出 = 干 * (1 - mix) + 延迟 * mix，写回 = 输入 + 延迟 * feedback
+    struct DelayLine {
+        bool enabled = false;
+        std::vector<float> line; // 交错双声道，按最长延迟分配
+        size_t length = 1;       // 当前延迟帧数
+        size_t position = 0;     // 写位置（帧）
+        float feedback = 0.4f;
+        float mix = 0.3f;
+    };
+
+    // Freeverb 的简化版：每个声道 4 个带阻尼的梳状滤波器并联，再串 2 个全通
+    struct Reverb {
+        static constexpr int COMBS = 4;
+        static constexpr int ALLPASSES = 2;
+        static constexpr float INPUT_GAIN = 0.015f;
+
+        bool enabled = false;
+        // 同一声道的 4 个梳状滤波器共用写位置、延迟各不相同，按 [位置][滤波器] 交错存，写入正好一个 __m128
+        std::vector<float> combs[2];
+        int combDelay[2][COMBS] = {};
+        int combSize = 0;
+        int combPosition = 0;
+        float combFilter[2][COMBS] = {};
+        std::vector<float> allpasses[2][ALLPASSES];
+        int allpassPosition[2][ALLPASSES] = {};
+        float feedback = 0.84f;
+        float damping = 0.2f;
+        float mix = 0.25f;
+
+        // 延迟长度取自 Freeverb（44100 下的帧数），右声道错开一点让声场变宽
+        void allocate(const int rate) {
+            static const int combTuning[COMBS] = {1116, 1188, 1277, 1356};
+            static const int allpassTuning[ALLPASSES] = {556, 441};
+            constexpr int SPREAD = 23;
+            const double scale = rate / 44100.0;
+            combSize = 0;
+            for (int c = 0; c < 2; ++c) {
+                for (int i = 0; i < COMBS; ++i) {
+                    combDelay[c][i] = std::max(1, static_cast<int>((combTuning[i] + SPREAD * c) * scale));
+                    combSize = std::max(combSize, combDelay[c][i] + 1);
+                }
+                for (int i = 0; i < ALLPASSES; ++i) {
+                    allpasses[c][i].assign(std::max(1, static_cast<int>((allpassTuning[i] + SPREAD * c) * scale)), 0.0f);
+                }
+            }
+            for (auto &comb: combs) {
+                comb.assign(static_cast<size_t>(combSize) * COMBS, 0.0f);
+            }
+        }
+
+        void clear() {
+            for (int c = 0; c < 2; ++c) {
+                std::fill(combs[c].begin(), combs[c].end(), 0.0f);
+                std::fill(std::begin(combFilter[c]), std::end(combFilter[c]), 0.0f);
+                for (auto &allpass: allpasses[c]) {
+                    std::fill(allpass.begin(), allpass.end(), 0.0f);
+                }
+            }
+        }
+
+        float diffuse(const int c, float x) {
+            for (int i = 0; i < ALLPASSES; ++i) {
+                std::vector<float> &allpass = allpasses[c][i];
+                int &position = allpassPosition[c][i];
+                const float delayed = allpass[position];
+                allpass[position] = x + delayed * 0.5f;
+                x = delayed - x;
+                if (++position == static_cast<int>(allpass.size())) {
+                    position = 0;
+                }
+            }
+            return x;
+        }
+    };
+
+    void biquadScalar(Biquad &f, float *buf, const size_t frames) {
+        for (size_t k = 0; k < frames; ++k) {
+            for (int c = 0; c < 2; ++c) {
+                const float x = buf[k * 2 + c];
+                const float y = f.b0 * x + f.z1[c];
+                f.z1[c] = f.b1 * x - f.a1 * y + f.z2[c];
+                f.z2[c] = f.b2 * x - f.a2 * y;
+                buf[k * 2 + c] = y;
+            }
+        }
+    }
+
+    // 段内读的都是至少 length 帧以前写的，互不依赖
+    void delayScalar(float *buf, const float *delayed, float *write, const size_t floats, const float feedback,
+                     const float mix) {
+        const float dry = 1.0f - mix;
+        for (size_t i = 0; i < floats; ++i) {
+            const float x = buf[i];
+            const float d = delayed[i];
+            buf[i] = x * dry + d * mix;
+            write[i] = x + d * feedback;
+        }
+    }
+
+    // 4 个梳状滤波器的输出按 (0 + 1) + (2 + 3) 求和，和 SSE2 的水平加法顺序一致
+    void reverbScalar(Reverb &r, float *buf, const size_t frames) {
+        const float undamped = 1.0f - r.damping;
+        const float dry = 1.0f - r.mix;
+        for (size_t k = 0; k < frames; ++k) {
+            const float input = (buf[k * 2] + buf[k * 2 + 1]) * Reverb::INPUT_GAIN;
+            for (int c = 0; c < 2; ++c) {
+                float *comb = r.combs[c].data();
+                float y[Reverb::COMBS];
+                for (int i = 0; i < Reverb::COMBS; ++i) {
+                    int read = r.combPosition - r.combDelay[c][i];
+                    if (read < 0) {
+                        read += r.combSize;
+                    }
+                    y[i] = comb[read * Reverb::COMBS + i];
+                    r.combFilter[c][i] = y[i] * undamped + r.combFilter[c][i] * r.damping;
+                    comb[r.combPosition * Reverb::COMBS + i] = input + r.combFilter[c][i] * r.feedback;
+                }
+                const float wet = r.diffuse(c, (y[0] + y[1]) + (y[2] + y[3]));
+                buf[k * 2 + c] = buf[k * 2 + c] * dry + wet * r.mix;
+            }
+            if (++r.combPosition == r.combSize) {
+                r.combPosition = 0;
+            }
+        }
+    }
+
+#ifdef MIX_SSE2
+    // 左右声道放在低两个通道里一起算，高两个不用
+    void biquadSSE2(Biquad &f, float *buf, const size_t frames) {
+        const __m128 b0 = _mm_set1_ps(f.b0);
+        const __m128 b1 = _mm_set1_ps(f.b1);
+        const __m128 b2 = _mm_set1_ps(f.b2);
+        const __m128 a1 = _mm_set1_ps(f.a1);
+        const __m128 a2 = _mm_set1_ps(f.a2);
+        __m128 z1 = _mm_setr_ps(f.z1[0], f.z1[1], 0.0f, 0.0f);
+        __m128 z2 = _mm_setr_ps(f.z2[0], f.z2[1], 0.0f, 0.0f);
+        for (size_t k = 0; k < frames; ++k) {
+            auto *frame = reinterpret_cast<double *>(buf + k * 2);
+            const __m128 x = _mm_castpd_ps(_mm_load_sd(frame));
+            const __m128 y = _mm_add_ps(_mm_mul_ps(b0, x), z1);
+            z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x), _mm_mul_ps(a1, y)), z2);
+            z2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+            _mm_store_sd(frame, _mm_castps_pd(y));
+        }
+        float state[4];
+        _mm_storeu_ps(state, z1);
+        f.z1[0] = state[0];
+        f.z1[1] = state[1];
+        _mm_storeu_ps(state, z2);
+        f.z2[0] = state[0];
+        f.z2[1] = state[1];
+    }
+
+    void delaySSE2(float *buf, const float *delayed, float *write, const size_t floats, const float feedback,
+                   const float mix) {
+        const __m128 dry = _mm_set1_ps(1.0f - mix);
+        const __m128 wet = _mm_set1_ps(mix);
+        const __m128 fb = _mm_set1_ps(feedback);
+        size_t i = 0;
+        for (; i + 4 <= floats; i += 4) {
+            const __m128 x = _mm_loadu_ps(buf + i);
+            const __m128 d = _mm_loadu_ps(delayed + i);
+            _mm_storeu_ps(buf + i, _mm_add_ps(_mm_mul_ps(x, dry), _mm_mul_ps(d, wet)));
+            _mm_storeu_ps(write + i, _mm_add_ps(x, _mm_mul_ps(d, fb)));
+        }
+        delayScalar(buf + i, delayed + i, write + i, floats - i, feedback, mix);
+    }
+
+    // 一个声道的 4 个梳状滤波器放在 4 个通道里：读位置各不相同只能逐个取，阻尼、反馈和写回一起做
+    void reverbSSE2(Reverb &r, float *buf, const size_t frames) {
+        const __m128 damping = _mm_set1_ps(r.damping);
+        const __m128 undamped = _mm_set1_ps(1.0f - r.damping);
+        const __m128 feedback = _mm_set1_ps(r.feedback);
+        const float dry = 1.0f - r.mix;
+        __m128 filter[2] = {_mm_loadu_ps(r.combFilter[0]), _mm_loadu_ps(r.combFilter[1])};
+        for (size_t k = 0; k < frames; ++k) {
+            const float input = (buf[k * 2] + buf[k * 2 + 1]) * Reverb::INPUT_GAIN;
+            for (int c = 0; c < 2; ++c) {
+                float *comb = r.combs[c].data();
+                int read[Reverb::COMBS];
+                for (int i = 0; i < Reverb::COMBS; ++i) {
+                    read[i] = r.combPosition - r.combDelay[c][i];
+                    if (read[i] < 0) {
+                        read[i] += r.combSize;
+                    }
+                }
+                const __m128 y = _mm_setr_ps(comb[read[0] * 4 + 0], comb[read[1] * 4 + 1],
+                                             comb[read[2] * 4 + 2], comb[read[3] * 4 + 3]);
+                filter[c] = _mm_add_ps(_mm_mul_ps(y, undamped), _mm_mul_ps(filter[c], damping));
+                _mm_storeu_ps(comb + r.combPosition * 4,
+                              _mm_add_ps(_mm_set1_ps(input), _mm_mul_ps(filter[c], feedback)));
+                const __m128 pairs = _mm_add_ps(y, _mm_shuffle_ps(y, y, _MM_SHUFFLE(2, 3, 0, 1)));
+                const float sum = _mm_cvtss_f32(_mm_add_ss(pairs, _mm_movehl_ps(pairs, pairs)));
+                const float wet = r.diffuse(c, sum);
+                buf[k * 2 + c] = buf[k * 2 + c] * dry + wet * r.mix;
+            }
+            if (++r.combPosition == r.combSize) {
+                r.combPosition = 0;
+            }
+        }
+        _mm_storeu_ps(r.combFilter[0], filter[0]);
+        _mm_storeu_ps(r.combFilter[1], filter[1]);
+    }
+#endif
+
+    struct EffectKernel {
+        const char *name;
+        void (*biquad)(Biquad &f, float *buf, size_t frames);
+        void (*delay)(float *buf, const float *delayed, float *write, size_t floats, float feedback, float mix);
+        void (*reverb)(Reverb &r, float *buf, size_t frames);
+    };
+
+    std::vector<EffectKernel> availableEffectKernels() {
+        std::vector<EffectKernel> kernels;
+#ifdef MIX_SSE2
+        kernels.push_back({"sse2", biquadSSE2, delaySSE2, reverbSSE2});
+#endif
+        kernels.push_back({"scalar", biquadScalar, delayScalar, reverbScalar});
+        return kernels;
+    }
+
+    const EffectKernel &effectKernel() {
+        static const EffectKernel kernel = availableEffectKernels().front();
+        return kernel;
+    }
+
+    void runBiquad(const EffectKernel &kernel, Biquad &f, float *buf, const size_t frames) {
+        kernel.biquad(f, buf, frames);
+        for (int c = 0; c < 2; ++c) {
+            f.z1[c] = flushDenormal(f.z1[c]);
+            f.z2[c] = flushDenormal(f.z2[c]);
+        }
+    }
+
+    // 按延迟长度和环形缓冲的边界切段，每段交给内核整段处理
+    void runDelay(const EffectKernel &kernel, DelayLine &d, float *buf, const size_t frames) {
+        const size_t size = d.line.size() / 2;
+        size_t done = 0;
+        while (done < frames) {
+            const size_t read = (d.position + size - d.length) % size;
+            const size_t n = std::min({frames - done, d.length, size - d.position, size - read});
+            kernel.delay(buf + done * 2, d.line.data() + read * 2, d.line.data() + d.position * 2, n * 2,
+                         d.feedback, d.mix);
+            d.position = (d.position + n) % size;
+            done += n;
+        }
+    }
+
+    void runReverb(const EffectKernel &kernel, Reverb &r, float *buf, const size_t frames) {
+        kernel.reverb(r, buf, frames);
+        for (auto &filters: r.combFilter) {
+            for (float &v: filters) {
+                v = flushDenormal(v);
+            }
+        }
+    }
+
+    // 单生产者单消费者环形缓冲：一端只写、一端只读，两边都不加锁。容量取 2 的幂
+    template<typename T>
+    class SpscRing {
+        std::vector<T> items;
+        size_t mask;
+        std::atomic<size_t> head{0}; // 读位置，只有消费者改
+        std::atomic<size_t> tail{0}; // 写位置，只有生产者改
+
+    public:
+        explicit SpscRing(const size_t capacity) : items(capacity), mask(capacity - 1) {
+        }
+
+        SpscRing(const SpscRing &) = delete;
+        SpscRing &operator=(const SpscRing &) = delete;
+
+        // 消费者调用
+        [[nodiscard]] size_t readable() const {
+            return tail.load(std::memory_order_acquire) - head.load(std::memory_order_relaxed);
+        }
+
+        // 生产者调用
+        [[nodiscard]] size_t writable() const {
+            return items.size() - (tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire));
+        }
+
+        size_t write(const T *data, size_t count) {
+            const size_t t = tail.load(std::memory_order_relaxed);
+            count = std::min(count, writable());
+            for (size_t i = 0; i < count; ++i) {
+                items[(t + i) & mask] = data[i];
+            }
+            tail.store(t + count, std::memory_order_release);
+            return count;
+        }
+
+        size_t read(T *data, size_t count) {
+            const size_t h = head.load(std::memory_order_relaxed);
+            count = std::min(count, readable());
+            for (size_t i = 0; i < count; ++i) {
+                data[i] = items[(h + i) & mask];
+            }
+            head.store(h + count, std::memory_order_release);
+            return count;
+        }
+
+        // 只在两端都不再访问时调用
+        void clear() {
+            head.store(0, std::memory_order_relaxed);
+            tail.store(0, std::memory_order_relaxed);
+        }
+
+        // 同上，容量仍取 2 的幂
+        void resize(const size_t capacity) {
+            items.assign(capacity, T());
+            mask = capacity - 1;
+            clear();
+        }
+    };
+
+    // 解码线程提前把每个通道解到各自的 PCM 环里，SDL 音频回调只做混音，
+    // 播放是否连续和渲染帧率无关，主线程也不再碰 Vorbis 解码。
+    // 游戏线程通过无锁命令环控制混音，混音再通过通知环把播完等事件报回来，两边都不加锁。
+    // 通道池在构造时定大小；对外的句柄带代数，通道被回收复用后旧句柄自动失效
+    class Audio {
+    public:
+        typedef long long Handle; // 代数 << HANDLE_BITS | 通道号，无效句柄为 -1
+
+        enum StealPolicy { STEAL_NONE, STEAL_OLDEST, STEAL_LOWEST };
+
+        // DEVICE 由声卡回调拉取、解码线程异步补数据；OFFLINE 没有设备和解码线程，由 render 按需算
+        enum Backend { DEVICE, OFFLINE };
+
+        static constexpr size_t NAME_SIZE = 128;
+        static constexpr size_t MAX_EVENTS = 1024;
+        static constexpr size_t MAX_SCHEDULED = 1024; // 混音那边最多同时挂着的定时命令
+        static constexpr int MAX_BUSES = 8; // 含主总线 0
+        static constexpr double MAX_DELAY_SECONDS = 1.0;
+
+        struct Command {
+            enum Type { PING, PLAY, START, STOP, PAUSE, VOLUME, PAN, PITCH, SEEK, MASTER_PAUSE, ROUTE, BUS, BUS_GAIN, EFFECT };
+            Type type = PING;
+            int voice = -1;
+            unsigned int generation = 0;
+            float value = 0; // PLAY 时为 loop
+            unsigned int seq = 0; // 游戏线程依次编号，混音检查有没有丢或乱序
+            long long time = 0; // 在音频时钟的这一帧生效，0 或已经过去的立即执行；MASTER_PAUSE 总是立即执行
+            char name[NAME_SIZE] = {}; // 只有 PLAY 用，定长以免回调里分配
+            // 总线命令的 voice 是总线号；EFFECT 的 value 非 0 为启用，params 含义见 busEffect
+            int effect = 0;
+            float params[3] = {};
+            double seconds = 0; // SEEK 的目标；float 放几分钟后就精确不到帧
+        };
+
+        struct Notification {
+            enum Type { FINISHED, FAILED };
+            Type type = FINISHED;
+            int voice = -1;
+            unsigned int generation = 0;
+        };
+
+        struct Event {
+            Notification::Type type;
+            Handle handle;
+        };
+
+        struct StressResult {
+            long long pushed = 0;
+            long long processed = 0;
+            long long errors = 0;
+            long long fullSpins = 0; // 命令环满了等待的次数
+            double ms = 0;
+        };
+
+        struct BusStats {
+            int bus = 0;
+            int parent = 0;
+            bool effects[EFFECT_COUNT] = {};
+            double ms = 0;   // 上次查询以来处理这条总线（效果加混进上级）花的时间
+            double load = 0; // ms 占同期音频时长的比例
+        };
+
+        struct VoiceStats {
+            int total = 0;
+            int used = 0;
+            long long stolen = 0;
+            long long rejected = 0; // 没有可用通道、也没有可抢的
+            long long droppedNotifications = 0; // 通知环满了丢掉的播完/失败通知，对应的通道不会自动回收
+            long long starved = 0; // 流式通道的 PCM 环供不上、只好补零的块数
+            long long lateCommands = 0; // 定时命令挂满了、只好提前执行的条数
+        };
+
+    private:
+        // 通道状态：回调 FREE -> LOADING（收到 PLAY 且上一代已回收）、READY -> SEEKING（跳转）、任意 -> RELEASING（停止或播完）；
+        // 解码线程 LOADING -> READY/FAILED、SEEKING -> READY、RELEASING -> FREE，前两个用 CAS，被回调抢先改掉就放弃
+        enum State { FREE, LOADING, READY, FAILED, SEEKING, RELEASING };
+
+        static constexpr int HANDLE_BITS = 20;
+        static constexpr int FRAMES = 1024;       // 设备缓冲帧数
+        static constexpr int DECODE_FRAMES = 1024; // 解码线程每次解的帧数
+        static constexpr size_t STAGING_FRAMES = 2048; // 重采样一次最多取的输入帧数，超过就分段
+        static constexpr int SAMPLE_RATE = 44100; // 向设备请求的采样率，设备可以改
+        static constexpr float MAX_GAIN = 8.0f;
+        static constexpr float MIN_PITCH = 0.25f;
+        static constexpr float MAX_PITCH = 4.0f;
+        static constexpr int MAX_SOURCE_RATE = 48000; // PCM 环按这个源采样率配，更高的文件能用的音调相应降低
+
+        struct Voice {
+            // 回调在 FREE -> LOADING 前写好，解码线程只在 LOADING 时读
+            char name[NAME_SIZE] = {};
+            int loop = 0;
+            std::atomic<int> seekFrame{0}; // 回调在 READY -> SEEKING 前写好
+            // 解码线程
+            std::unique_ptr<VorbisStream> stream;
+            const SampleBank::Sample *sample = nullptr; // 短音效直接读常驻 PCM，不用 stream 和 pcm 环
+            int rate = SAMPLE_RATE; // 源采样率，和 stream/sample 一起在 READY 前写好
+            SpscRing<short> pcm{2}; // 交错的双声道，知道设备采样率后按 ringFrames 分配
+            std::atomic<int> state{FREE};
+            std::atomic<bool> drained{false}; // 不循环的流已经解完最后一段
+            // 只有混音回调访问
+            bool active = false;
+            bool starting = false; // 收到 PLAY，等上一代回收完再开始加载
+            bool paused = false;
+            bool seekPending = false; // 等到 READY 再跳转
+            bool held = false; // 定时开始的通道先加载好，到 START 才混音
+            double seekTarget = 0; // 秒，换算成帧要等知道源采样率
+            int cursor = 0; // 播放常驻 PCM 时的帧位置
+            float gain = 1.0f;
+            float pan = 0.0f;   // -1 最左，1 最右
+            float pitch = 1.0f; // 播放速度倍数，音高随之变化
+            float left = 1.0f;  // 上一块结束时实际用的左右增益，下一块从这里渐变到目标
+            float right = 1.0f;
+            double phase = 0;   // 重采样位置，相对 tail 第 0 帧
+            float tail[6] = {}; // 上一块剩下的 3 帧输入，三次插值要用到前后各一帧
+            unsigned int generation = 0;
+            char startName[NAME_SIZE] = {};
+            int startLoop = 0;
+            int bus = 0; // 混进哪条总线
+        };
+
+        // 总线的缓冲由游戏线程在发出 BUS 之前分配，之后只有混音回调访问
+        struct Bus {
+            std::vector<float> buffer; // 这一块混进来的声音，原地处理效果
+            Biquad highpass;
+            Biquad lowpass;
+            DelayLine delay;
+            Reverb reverb;
+            bool used = false;
+            int parent = 0; // 总比自己的编号小
+            float gain = 1.0f;
+            float applied = 1.0f; // 上一块实际用的增益，下一块渐变到 gain
+            // 回调累加，游戏线程读
+            std::atomic<Uint64> ticks{0};
+            std::atomic<long long> frames{0};
+        };
+
+        // 游戏线程这边记的总线信息，算统计用
+        struct BusInfo {
+            int parent = 0;
+            bool effects[EFFECT_COUNT] = {};
+            Uint64 lastTicks = 0;
+            long long lastFrames = 0;
+        };
+
+        // 只有游戏线程访问
+        struct Slot {
+            unsigned int generation = 1;
+            bool used = false;
+            int priority = 0;
+            unsigned long long started = 0; // 开始顺序，越小越老
+        };
+
+        SDL_AudioDeviceID audioDeviceID = 0;
+        const Backend backend;
+        const int voiceCount;
+        std::unique_ptr<Voice[]> voices;
+        SpscRing<Command> commands{1024};
+        SpscRing<Notification> notifications{1024};
+        SampleBank bank;
+        // 只有解码线程访问：解到过结尾的流式文件的总帧数，循环的跳转先取模，不用先越过结尾再解一遍
+        std::unordered_map<std::string, int> streamLengths;
+
+        // 只有游戏线程访问
+        std::vector<Slot> slots;
+        std::deque<Event> events; // 已经从通知环取出、还没交给 Lua 的事件
+        unsigned int nextSeq = 0;
+        unsigned long long nextStart = 0;
+        StealPolicy stealPolicy = STEAL_LOWEST;
+        VoiceStats stats;
+        std::unique_ptr<Bus[]> buses{new Bus[MAX_BUSES]};
+        BusInfo busInfo[MAX_BUSES];
+        int busCount = 1;
+
+        // 只有混音回调访问
+        const MixKernel &kernel = mixKernel();
+        const EffectKernel &effects = effectKernel();
+        int deviceRate = SAMPLE_RATE;
+        std::vector<short> voiceBuffer; // 从通道取出的 s16
+        std::vector<float> staging; // tail + 转成 float 的输入
+        bool masterPaused = true; // 和原来设备打开时默认暂停一致
+        long long clock = 0; // 音频时钟：整体暂停时不走的已混帧数
+        // 还没到时间的命令放在固定的 timedCommands 槽里，scheduled 是按 (time, order) 排的小顶堆，只存槽号，
+        // 插入和取出都是 O(log n)，不用挪动整条命令；容量固定、回调里不分配
+        struct Timed {
+            long long time;
+            unsigned long long order; // 同一时刻的按到达顺序
+            int slot;
+        };
+        std::vector<Command> timedCommands;
+        std::vector<int> freeTimed;
+        std::vector<Timed> scheduled;
+        unsigned long long scheduleOrder = 0;
+        std::atomic<long long> lateCommands{0}; // 槽用完了只好提前执行的
+        // 给游戏线程读时钟的顺序锁：写时 clockSeq 为奇数
+        std::atomic<unsigned int> clockSeq{0};
+        std::atomic<long long> clockFrames{0};
+        std::atomic<Uint64> clockTicks{0};
+        std::atomic<bool> clockRunning{false};
+        int deviceFrames = FRAMES; // 设备缓冲帧数，估算正在出声的位置要减掉
+        unsigned int expectedSeq = 0;
+        std::atomic<long long> processed{0};
+        std::atomic<long long> errors{0};
+        std::atomic<long long> droppedNotifications{0};
+        std::atomic<long long> starved{0};
+        double maxStep = MAX_PITCH; // 每输出一帧最多前进的输入帧数，受 PCM 环容量限制
+
+        std::vector<short> renderBuffer; // 离线渲染时同步解码用，代替解码线程里的局部缓冲
+
+        std::thread decoder;
+        std::mutex decoderMutex; // 只用于解码线程的等待，回调不碰
+        std::condition_variable wakeDecoder;
+        bool quit = false;
+
+        static void callback(void *userdata, Uint8 *stream, const int len) {
+            static_cast<Audio *>(userdata)->mix(reinterpret_cast<short *>(stream), len / 4);
+        }
+
+        static Handle makeHandle(const int voice, const unsigned int generation) {
+            return static_cast<Handle>(generation) << HANDLE_BITS | voice;
+        }
+
+        void notify(const Notification::Type type, const int voice) {
+            Notification notification;
+            notification.type = type;
+            notification.voice = voice;
+            notification.generation = voices[voice].generation;
+            if (notifications.write(&notification, 1) == 0) {
+                ++droppedNotifications;
+            }
+        }
+
+        // 停止混音并交给解码线程回收；还没开始加载的直接作废
+        void release(Voice &voice) {
+            voice.active = false;
+            if (voice.starting) {
+                voice.starting = false;
+                return;
+            }
+            voice.state.store(RELEASING, std::memory_order_release);
+        }
+
+        // tail 清零后从第 2 帧算起，第一个输出帧正好是源的第一帧，开始和跳转都不会晚两帧
+        static void resetResampler(Voice &voice) {
+            voice.phase = 2.0;
+            std::fill(std::begin(voice.tail), std::end(voice.tail), 0.0f);
+        }
+
+        // 等功率声像：居中时左右都是 gain，转到一侧时那一侧升到 √2 倍、另一侧降到 0，总功率不变
+        static MixGain panGain(const float gain, const float pan) {
+            const float angle = (pan + 1.0f) * 0.25f * static_cast<float>(M_PI);
+            return {gain * static_cast<float>(M_SQRT2) * std::cos(angle),
+                    gain * static_cast<float>(M_SQRT2) * std::sin(angle), 0.0f, 0.0f};
+        }
+
+        // PLAY 之后等通道空出来再交给解码线程；加载或上一次跳转还没完成时收到的跳转一直挂着，到 READY 再发
+        void kick(Voice &voice) {
+            const int state = voice.state.load(std::memory_order_acquire);
+            if (voice.starting && state == FREE) {
+                memcpy(voice.name, voice.startName, NAME_SIZE);
+                voice.loop = voice.startLoop;
+                voice.cursor = 0;
+                resetResampler(voice);
+                const MixGain gain = panGain(voice.gain, voice.pan);
+                voice.left = gain.left;
+                voice.right = gain.right;
+                voice.starting = false;
+                voice.state.store(LOADING, std::memory_order_release);
+            } else if (voice.seekPending && state == READY) {
+                const int frame = static_cast<int>(std::min<double>(voice.seekTarget * voice.rate,
+                                                                    std::numeric_limits<int>::max()));
+                if (voice.sample) { // 常驻 PCM 挪一下游标就行
+                    voice.seekPending = false;
+                    resetResampler(voice);
+                    voice.cursor = voice.loop && voice.sample->frames > 0 ? frame % voice.sample->frames
+                                                                          : std::min(frame, voice.sample->frames);
+                    return;
+                }
+                voice.seekFrame.store(frame, std::memory_order_relaxed);
+                int expected = READY;
+                if (voice.state.compare_exchange_strong(expected, SEEKING, std::memory_order_acq_rel)) {
+                    voice.seekPending = false; // 没换成功就留到下一块再试
+                    resetResampler(voice);
+                }
+            }
+        }
+
+        // std 的堆是大顶堆，比较反过来就是最早的在堆顶
+        static bool later(const Timed &a, const Timed &b) {
+            return a.time != b.time ? a.time > b.time : a.order > b.order;
+        }
+
+        void schedule(const Command &command) {
+            if (freeTimed.empty()) {
+                ++lateCommands;
+                execute(command);
+                return;
+            }
+            const int slot = freeTimed.back();
+            freeTimed.pop_back();
+            timedCommands[slot] = command;
+            scheduled.push_back({command.time, scheduleOrder++, slot});
+            std::push_heap(scheduled.begin(), scheduled.end(), later);
+        }
+
+        void apply(const Command &command) {
+            if (command.seq != expectedSeq) {
+                ++errors;
+            }
+            expectedSeq = command.seq + 1;
+            ++processed;
+            if (command.time > clock && command.type != Command::PLAY && command.type != Command::MASTER_PAUSE) {
+                schedule(command);
+                return;
+            }
+            execute(command);
+        }
+
+        // 打开延迟和混响时清掉上次留下的尾音；关掉不清，改参数也不清
+        void configureBus(Bus &bus, const Command &command) {
+            const bool enabled = command.value != 0;
+            const float *params = command.params;
+            if (command.type == Command::BUS) {
+                bus.parent = static_cast<int>(command.value);
+                bus.used = true;
+                return;
+            }
+            if (command.type == Command::BUS_GAIN) {
+                bus.gain = std::max(0.0f, std::min(command.value, MAX_GAIN));
+                return;
+            }
+            switch (command.effect) {
+                case EFFECT_HIGHPASS:
+                case EFFECT_LOWPASS: {
+                    Biquad &filter = command.effect == EFFECT_HIGHPASS ? bus.highpass : bus.lowpass;
+                    if (enabled && !filter.enabled) {
+                        filter = Biquad();
+                    }
+                    filter.design(static_cast<EffectType>(command.effect), params[0], params[1], deviceRate);
+                    filter.enabled = enabled;
+                    break;
+                }
+                case EFFECT_DELAY: {
+                    DelayLine &delay = bus.delay;
+                    if (enabled && !delay.enabled) {
+                        std::fill(delay.line.begin(), delay.line.end(), 0.0f);
+                        delay.position = 0;
+                    }
+                    const auto frames = static_cast<long long>(static_cast<double>(params[0]) * deviceRate);
+                    delay.length = static_cast<size_t>(std::max(1LL, std::min(frames, static_cast<long long>(
+                                                                                     delay.line.size() / 2 - 1))));
+                    delay.feedback = std::max(0.0f, std::min(params[1], 0.95f));
+                    delay.mix = std::max(0.0f, std::min(params[2], 1.0f));
+                    delay.enabled = enabled;
+                    break;
+                }
+                case EFFECT_REVERB: {
+                    Reverb &reverb = bus.reverb;
+                    if (enabled && !reverb.enabled) {
+                        reverb.clear();
+                    }
+                    // 和 Freeverb 一样把房间大小、阻尼映射到反馈 0.7..0.98、阻尼 0..0.4
+                    reverb.feedback = 0.7f + 0.28f * std::max(0.0f, std::min(params[0], 1.0f));
+                    reverb.damping = 0.4f * std::max(0.0f, std::min(params[1], 1.0f));
+                    reverb.mix = std::max(0.0f, std::min(params[2], 1.0f));
+                    reverb.enabled = enabled;
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+
+        void execute(const Command &command) {
+            if (command.type == Command::MASTER_PAUSE) {
+                masterPaused = command.value != 0;
+                return;
+            }
+            if (command.type == Command::BUS || command.type == Command::BUS_GAIN || command.type == Command::EFFECT) {
+                if (command.voice >= 0 && command.voice < MAX_BUSES) {
+                    configureBus(buses[command.voice], command);
+                }
+                return;
+            }
+            if (command.voice < 0 || command.voice >= voiceCount) {
+                return;
+            }
+            Voice &voice = voices[command.voice];
+            if (command.type == Command::PLAY) {
+                voice.active = true;
+                voice.starting = true;
+                voice.paused = false;
+                voice.seekPending = false;
+                voice.gain = 1.0f;
+                voice.pan = 0.0f;
+                voice.pitch = 1.0f;
+                voice.generation = command.generation;
+                voice.bus = 0;
+                memcpy(voice.startName, command.name, NAME_SIZE);
+                voice.startLoop = static_cast<int>(command.value);
+                // 定时开始的立即加载，到点再由 START 放开，解码耗时不影响起点
+                voice.held = command.time > clock;
+                if (voice.held) {
+                    Command start = command;
+                    start.type = Command::START;
+                    schedule(start);
+                }
+                return;
+            }
+            // 其余命令只作用于同一代，通道已经播完或被抢走时忽略
+            if (!voice.active || voice.generation != command.generation) {
+                return;
+            }
+            switch (command.type) {
+                case Command::START:
+                    voice.held = false;
+                    break;
+                case Command::STOP:
+                    release(voice);
+                    if (command.time != 0) {
+                        notify(Notification::FINISHED, command.voice); // 游戏线程还占着这个通道，要靠通知回收
+                    }
+                    break;
+                case Command::PAUSE:
+                    voice.paused = command.value != 0;
+                    break;
+                case Command::VOLUME:
+                    voice.gain = std::max(0.0f, std::min(command.value, MAX_GAIN));
+                    break;
+                case Command::PAN:
+                    voice.pan = std::max(-1.0f, std::min(command.value, 1.0f));
+                    break;
+                case Command::PITCH:
+                    voice.pitch = std::max(MIN_PITCH, std::min(command.value, MAX_PITCH));
+                    break;
+                case Command::SEEK:
+                    voice.seekPending = true;
+                    voice.seekTarget = command.seconds;
+                    break;
+                case Command::ROUTE: {
+                    const int bus = static_cast<int>(command.value);
+                    voice.bus = bus >= 0 && bus < MAX_BUSES && buses[bus].used ? bus : 0;
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+
+        // 从通道取最多 frames 帧 s16：常驻 PCM 按游标拷出来，循环的绕回开头；流式的读 PCM 环
+        size_t pull(Voice &voice, short *out, const size_t frames) {
+            if (!voice.sample) {
+                return voice.pcm.read(out, frames * 2) / 2;
+            }
+            const SampleBank::Sample &sample = *voice.sample;
+            size_t done = 0;
+            while (done < frames) {
+                if (voice.cursor >= sample.frames) {
+                    if (!voice.loop) {
+                        break;
+                    }
+                    voice.cursor = 0;
+                }
+                const size_t n = std::min(frames - done, static_cast<size_t>(sample.frames - voice.cursor));
+                memcpy(out + done * 2, sample.pcm.data() + static_cast<size_t>(voice.cursor) * 2, n * 2 * sizeof(short));
+                voice.cursor += static_cast<int>(n);
+                done += n;
+            }
+            return done;
+        }
+
+        // 一块最多要从环里取 MAX_PITCH * MAX_SOURCE_RATE / deviceRate * FRAMES 帧（再加分段时插值多取的几帧），
+        // 而解码线程要空出整整 DECODE_FRAMES 才补，环里最少也只有容量减去一个解码块。两项加起来取 2 的幂。
+        // 设备采样率低得离谱时不再跟着放大，由 maxStep 限制音调
+        static size_t ringFrames(const int deviceRate) {
+            const auto perBlock = static_cast<size_t>(std::ceil(static_cast<double>(MAX_PITCH) * MAX_SOURCE_RATE /
+                                                                std::max(deviceRate, 8000) * FRAMES)) + 8;
+            size_t frames = 1;
+            while (frames < perBlock + DECODE_FRAMES) {
+                frames <<= 1;
+            }
+            return frames;
+        }
+
+        void allocateRings() {
+            const size_t frames = ringFrames(deviceRate);
+            for (int i = 0; i < voiceCount; ++i) {
+                voices[i].pcm.resize(frames * 2);
+            }
+            maxStep = static_cast<double>(frames - DECODE_FRAMES - 8) / FRAMES;
+        }
+
+        // 按音调和采样率比例取输入、重采样并带增益累加进 acc；源已经结束、不会再有数据时返回 false。
+        // 源采样率超过 MAX_SOURCE_RATE 时步长钳到环能供上的 maxStep
+        bool mixVoice(Voice &voice, float *acc, const size_t frames) {
+            double step = voice.pitch * voice.rate / static_cast<double>(deviceRate);
+            if (!voice.sample) {
+                step = std::min(step, maxStep);
+            }
+            const MixGain target = panGain(voice.gain, voice.pan);
+            const float leftStep = (target.left - voice.left) / static_cast<float>(frames);
+            const float rightStep = (target.right - voice.right) / static_cast<float>(frames);
+            bool more = true;
+            size_t done = 0;
+            while (done < frames) {
+                const size_t n = std::min(frames - done, static_cast<size_t>((STAGING_FRAMES - 2) / step));
+                // 输出第 k 帧用 staging 里 floor(phase + step * k) 起的 4 帧，前 3 帧是上次留下的 tail
+                const double end = voice.phase + step * static_cast<double>(n);
+                const auto advance = static_cast<size_t>(end);
+                const size_t last = static_cast<size_t>(voice.phase + step * static_cast<double>(n - 1)) + 4;
+                const size_t need = std::max(last, advance + 3) - 3;
+                const bool drained = voice.sample || voice.drained.load(std::memory_order_acquire);
+                const size_t got = pull(voice, voiceBuffer.data(), need);
+                if (got < need) {
+                    std::fill(voiceBuffer.begin() + static_cast<std::ptrdiff_t>(got * 2),
+                              voiceBuffer.begin() + static_cast<std::ptrdiff_t>(need * 2), 0);
+                    more = more && !drained;
+                    if (!drained) {
+                        ++starved;
+                    }
+                }
+                std::copy(std::begin(voice.tail), std::end(voice.tail), staging.begin());
+                toFloat(staging.data() + 6, voiceBuffer.data(), need * 2);
+
+                const auto f = static_cast<float>(done);
+                const MixGain gain{voice.left + leftStep * f, voice.right + rightStep * f, leftStep, rightStep};
+                if (step == 1.0 && voice.phase == 0.0) {
+                    kernel.accumulate(acc + done * 2, staging.data() + 2, gain, n);
+                } else {
+                    kernel.resample(acc + done * 2, staging.data(), voice.phase, step, gain, n);
+                }
+                std::copy(staging.begin() + static_cast<std::ptrdiff_t>(advance * 2),
+                          staging.begin() + static_cast<std::ptrdiff_t>(advance * 2 + 6), std::begin(voice.tail));
+                voice.phase = end - static_cast<double>(advance);
+                done += n;
+            }
+            voice.left = target.left;
+            voice.right = target.right;
+            return more;
+        }
+
+        void applyCommands() {
+            Command command;
+            while (commands.read(&command, 1) == 1) {
+                apply(command);
+            }
+        }
+
+        // 子总线的编号总比上级大，从大往小处理，轮到上级时下面的都已经混进来了
+        void mixBuses(const int n) {
+            const auto frames = static_cast<size_t>(n);
+            for (int b = MAX_BUSES - 1; b >= 0; --b) {
+                Bus &bus = buses[b];
+                if (!bus.used) {
+                    continue;
+                }
+                const Uint64 start = SDL_GetPerformanceCounter();
+                float *buffer = bus.buffer.data();
+                if (bus.highpass.enabled) {
+                    runBiquad(effects, bus.highpass, buffer, frames);
+                }
+                if (bus.lowpass.enabled) {
+                    runBiquad(effects, bus.lowpass, buffer, frames);
+                }
+                if (bus.delay.enabled) {
+                    runDelay(effects, bus.delay, buffer, frames);
+                }
+                if (bus.reverb.enabled) {
+                    runReverb(effects, bus.reverb, buffer, frames);
+                }
+                const float step = (bus.gain - bus.applied) / static_cast<float>(n);
+                if (b > 0) {
+                    kernel.accumulate(buses[bus.parent].buffer.data(), buffer, {bus.applied, bus.applied, step, step},
+                                      frames);
+                } else if (bus.applied != 1.0f || step != 0.0f) { // 主总线没有上级，原地乘
+                    for (size_t k = 0; k < frames; ++k) {
+                        const float g = bus.applied + step * static_cast<float>(k);
+                        buffer[k * 2] *= g;
+                        buffer[k * 2 + 1] *= g;
+                    }
+                }
+                bus.applied = bus.gain;
+                bus.ticks.fetch_add(SDL_GetPerformanceCounter() - start, std::memory_order_relaxed);
+                bus.frames.fetch_add(n, std::memory_order_relaxed);
+            }
+        }
+
+        // 混一块不超过 FRAMES 帧的输出：通道混进各自的总线，总线加效果后逐级混到主总线
+        void mixBlock(short *out, const int n) {
+            const size_t count = static_cast<size_t>(n) * 2;
+            for (int b = 0; b < MAX_BUSES; ++b) {
+                if (buses[b].used) {
+                    std::fill(buses[b].buffer.begin(), buses[b].buffer.begin() + static_cast<std::ptrdiff_t>(count), 0.0f);
+                }
+            }
+            for (int i = 0; i < voiceCount && !masterPaused; ++i) {
+                Voice &voice = voices[i];
+                if (!voice.active) {
+                    continue;
+                }
+                kick(voice);
+                const int state = voice.state.load(std::memory_order_acquire);
+                if (state == FAILED) {
+                    release(voice);
+                    notify(Notification::FAILED, i);
+                    continue;
+                }
+                if (state != READY || voice.paused || voice.held) {
+                    continue;
+                }
+                if (!mixVoice(voice, buses[voice.bus].buffer.data(), static_cast<size_t>(n))) {
+                    release(voice);
+                    notify(Notification::FINISHED, i);
+                }
+            }
+            if (!masterPaused) {
+                mixBuses(n);
+            }
+            kernel.saturate(out, buses[0].buffer.data(), count);
+        }
+
+        // 混 frames 帧，在定时命令的时刻切开，让它们精确到帧生效
+        void mixTimed(short *out, int frames) {
+            while (frames > 0) {
+                while (!scheduled.empty() && scheduled.front().time <= clock) {
+                    std::pop_heap(scheduled.begin(), scheduled.end(), later);
+                    const int slot = scheduled.back().slot;
+                    scheduled.pop_back();
+                    freeTimed.push_back(slot);
+                    const Command command = timedCommands[slot]; // execute 可能又 schedule，先拷出来
+                    execute(command);
+                }
+                int n = std::min(frames, FRAMES);
+                if (!scheduled.empty() && !masterPaused) {
+                    n = static_cast<int>(std::min<long long>(n, scheduled.front().time - clock));
+                }
+                mixBlock(out, n);
+                if (!masterPaused) {
+                    clock += n;
+                }
+                out += static_cast<ptrdiff_t>(n) * 2;
+                frames -= n;
+            }
+            const unsigned int seq = clockSeq.load(std::memory_order_relaxed);
+            clockSeq.store(seq + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            clockFrames.store(clock, std::memory_order_relaxed);
+            clockTicks.store(SDL_GetPerformanceCounter(), std::memory_order_relaxed);
+            clockRunning.store(!masterPaused, std::memory_order_relaxed);
+            clockSeq.store(seq + 2, std::memory_order_release);
+        }
+
+        // 在音频线程上运行：只读命令环和 PCM 环，不解码、不分配、不加锁
+        void mix(short *out, const int frames) {
+            [[maybe_unused]] const DenormalGuard guard;
+            applyCommands();
+            mixTimed(out, frames);
+        }
+
+        // 把 PCM 环补满，流结束时记下长度，按 loop 从头再来或标记 drained
+        void fill(Voice &voice, std::vector<short> &samples) {
+            while (!voice.drained.load(std::memory_order_relaxed) &&
+                   voice.pcm.writable() >= static_cast<size_t>(DECODE_FRAMES) * 2) {
+                const int n = voice.stream->read(samples.data(), DECODE_FRAMES);
+                voice.pcm.write(samples.data(), static_cast<size_t>(n) * 2);
+                if (n < DECODE_FRAMES) {
+                    streamLengths[voice.name] = voice.stream->tell();
+                    if (!voice.loop || !voice.stream->rewind()) {
+                        voice.drained.store(true, std::memory_order_release);
+                    }
+                }
+            }
+        }
+
+        // from -> to；期间被回调改成 RELEASING 时留给下一轮回收
+        static void advance(Voice &voice, int from, const State to) {
+            voice.state.compare_exchange_strong(from, to, std::memory_order_acq_rel);
+        }
+
+        void load(Voice &voice, std::vector<short> &samples) {
+            voice.sample = bank.get(voice.name);
+            if (voice.sample) {
+                voice.rate = voice.sample->rate;
+                advance(voice, LOADING, READY);
+                return;
+            }
+            voice.stream = std::make_unique<VorbisStream>(voice.name);
+            if (!voice.stream->valid()) {
+                printf("failed to open file: %s\n", voice.name);
+                advance(voice, LOADING, FAILED);
+            } else {
+                voice.rate = voice.stream->sampleRate();
+                fill(voice, samples);
+                advance(voice, LOADING, READY);
+            }
+        }
+
+        // 解码线程的一轮：加载、补满、跳转、回收各通道；离线渲染时在混音前同步调用
+        void service(std::vector<short> &samples) {
+            for (int i = 0; i < voiceCount; ++i) {
+                Voice &voice = voices[i];
+                switch (voice.state.load(std::memory_order_acquire)) {
+                    case LOADING:
+                        load(voice, samples);
+                        break;
+                    case READY:
+                        if (voice.stream) {
+                            fill(voice, samples);
+                        }
+                        break;
+                    case SEEKING: {
+                        // 回调已经停止读这个环，可以清空
+                        voice.pcm.clear();
+                        voice.drained.store(false, std::memory_order_relaxed);
+                        int frame = voice.seekFrame.exchange(0, std::memory_order_relaxed);
+                        const auto known = streamLengths.find(voice.name);
+                        if (voice.loop && known != streamLengths.end() && known->second > 0) {
+                            frame %= known->second;
+                        }
+                        bool ok = voice.stream->seek(frame);
+                        if (!ok && voice.stream->tell() > 0) {
+                            streamLengths[voice.name] = voice.stream->tell();
+                            if (voice.loop) {
+                                // 第一次越过结尾才知道文件长度，绕回来再解一遍；之后同一个文件直接取模
+                                ok = voice.stream->seek(frame % voice.stream->tell());
+                            }
+                        }
+                        if (!ok) {
+                            voice.drained.store(true, std::memory_order_release);
+                        }
+                        fill(voice, samples);
+                        advance(voice, SEEKING, READY);
+                        break;
+                    }
+                    case RELEASING:
+                        voice.stream.reset();
+                        if (voice.sample) {
+                            voice.sample = nullptr;
+                            bank.release(voice.name);
+                        }
+                        voice.pcm.clear();
+                        voice.drained.store(false, std::memory_order_relaxed);
+                        voice.state.store(FREE, std::memory_order_release);
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+
+        void run() {
+            std::vector<short> samples(DECODE_FRAMES * 2);
+            std::unique_lock<std::mutex> lock(decoderMutex);
+            while (!quit) {
+                lock.unlock();
+                service(samples);
+                lock.lock();
+                wakeDecoder.wait_for(lock, std::chrono::milliseconds(5));
+            }
+        }
+
+        bool push(const Command::Type type, const int voice, const unsigned int generation, const float value,
+                  const char *name = nullptr, const long long time = 0) {
+            Command command;
+            command.type = type;
+            command.voice = voice;
+            command.generation = generation;
+            command.value = value;
+            command.time = time;
+            if (name) {
+                strncpy(command.name, name, NAME_SIZE - 1);
+            }
+            return send(command);
+        }
+
+        bool send(Command &command) {
+            command.seq = nextSeq;
+            if (commands.write(&command, 1) == 0) {
+                return false;
+            }
+            ++nextSeq;
+            return true;
+        }
+
+        // 延迟线按 MAX_DELAY_SECONDS 分配，多一帧让最长延迟时读写不落在同一位置
+        void allocateBus(Bus &bus) const {
+            bus.buffer.assign(FRAMES * 2, 0.0f);
+            bus.delay.line.assign((static_cast<size_t>(MAX_DELAY_SECONDS * deviceRate) + 1) * 2, 0.0f);
+            bus.reverb.allocate(deviceRate);
+        }
+
+        // 句柄仍然指向正在用的那一代时返回通道号，否则 -1
+        int resolve(const Handle handle) const {
+            if (handle < 0) {
+                return -1;
+            }
+            const int voice = static_cast<int>(handle & ((1 << HANDLE_BITS) - 1));
+            const auto generation = static_cast<unsigned int>(handle >> HANDLE_BITS);
+            if (voice >= voiceCount || !slots[voice].used || slots[voice].generation != generation) {
+                return -1;
+            }
+            return voice;
+        }
+
+        // 游戏线程上回收通道，旧句柄随代数加一失效
+        void retire(const int voice) {
+            slots[voice].used = false;
+            ++slots[voice].generation;
+        }
+
+        // 把通知环里的事件转到游戏线程这边，顺便回收播完的通道
+        void pump() {
+            Notification notification;
+            while (notifications.read(&notification, 1) == 1) {
+                Slot &slot = slots[notification.voice];
+                if (!slot.used || slot.generation != notification.generation) {
+                    continue; // 已经被关掉或抢走
+                }
+                retire(notification.voice);
+                events.push_back({notification.type, makeHandle(notification.voice, notification.generation)});
+            }
+            while (events.size() > MAX_EVENTS) { // Lua 一直不取时只留最近的
+                events.pop_front();
+            }
+        }
+
+        int findSlot(const int priority) {
+            int victim = -1;
+            for (int i = 0; i < voiceCount; ++i) {
+                const Slot &slot = slots[i];
+                if (!slot.used) {
+                    return i;
+                }
+                if (stealPolicy == STEAL_NONE || slot.priority > priority) {
+                    continue;
+                }
+                if (victim == -1) {
+                    victim = i;
+                    continue;
+                }
+                const Slot &best = slots[victim];
+                const bool older = slot.started < best.started;
+                if (stealPolicy == STEAL_OLDEST ? older
+                                                : slot.priority < best.priority ||
+                                                  (slot.priority == best.priority && older)) {
+                    victim = i;
+                }
+            }
+            if (victim != -1) {
+                push(Command::STOP, victim, slots[victim].generation, 0);
+                retire(victim);
+                ++stats.stolen;
+            }
+            return victim;
+        }
+
+    public:
+        // OFFLINE 时 rate 就是输出采样率；DEVICE 时向设备请求 SAMPLE_RATE，以设备给的为准
+        explicit Audio(const int voiceCount = 256, const Backend backend = DEVICE, const int rate = SAMPLE_RATE)
+            : backend(backend), voiceCount(std::max(1, std::min(voiceCount, 1 << HANDLE_BITS))),
+              voices(new Voice[this->voiceCount]), slots(this->voiceCount) {
+            voiceBuffer.resize(STAGING_FRAMES * 2);
+            staging.resize((STAGING_FRAMES + 3) * 2);
+            timedCommands.resize(MAX_SCHEDULED);
+            freeTimed.reserve(MAX_SCHEDULED);
+            for (int i = static_cast<int>(MAX_SCHEDULED) - 1; i >= 0; --i) {
+                freeTimed.push_back(i);
+            }
+            scheduled.reserve(MAX_SCHEDULED);
+            if (backend == OFFLINE) {
+                deviceRate = std::max(1, rate);
+                allocateRings();
+                renderBuffer.resize(DECODE_FRAMES * 2);
+                allocateBus(buses[0]);
+                buses[0].used = true;
+                return;
+            }
+            SDL_AudioSpec spec;
+            spec.freq = SAMPLE_RATE;
+            spec.format = AUDIO_S16;
+            spec.channels = 2;
+            spec.samples = FRAMES;
+            spec.callback = callback;
+            spec.userdata = this;
+            decoder = std::thread(&Audio::run, this);
+            // 设备不支持 44100 时用它自己的采样率，各通道在混音时转换
+            SDL_AudioSpec obtained;
+            audioDeviceID = SDL_OpenAudioDevice(nullptr, 0, &spec, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+            if (audioDeviceID != 0) {
+                deviceRate = obtained.freq;
+                deviceFrames = obtained.samples;
+            }
+            allocateRings(); // 设备还没开始回调，解码线程也只碰已经在用的通道
+            allocateBus(buses[0]);
+            buses[0].used = true;
+            // 设备一直开着，整体暂停改由混音处理，游戏线程不必再调用会加设备锁的 SDL_PauseAudioDevice
+            SDL_PauseAudioDevice(audioDeviceID, 0);
+        }
+
+        ~Audio() {
+            if (backend == OFFLINE) {
+                return;
+            }
+            SDL_CloseAudioDevice(audioDeviceID); // 等回调退出
+            {
+                std::lock_guard<std::mutex> lock(decoderMutex);
+                quit = true;
+            }
+            wakeDecoder.notify_one();
+            decoder.join();
+        }
+
+        Audio(const Audio &) = delete;
+        Audio &operator=(const Audio &) = delete;
+
+        [[nodiscard]] int sampleRate() const { return deviceRate; }
+
+        // 正在出声的那一帧在音频时钟上的位置：上次回调混到的位置减去设备缓冲，再按回调之后经过的时间往前推。
+        // 离线后端就是已经渲染的帧数
+        long long position() {
+            long long frames;
+            Uint64 ticks;
+            bool running;
+            for (;;) {
+                const unsigned int seq = clockSeq.load(std::memory_order_acquire);
+                frames = clockFrames.load(std::memory_order_relaxed);
+                ticks = clockTicks.load(std::memory_order_relaxed);
+                running = clockRunning.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if ((seq & 1) == 0 && seq == clockSeq.load(std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            if (backend == OFFLINE) {
+                return frames;
+            }
+            if (!running) {
+                return frames; // 暂停时设备缓冲里的已经放完
+            }
+            const long long start = std::max(0LL, frames - deviceFrames);
+            const double elapsed = static_cast<double>(SDL_GetPerformanceCounter() - ticks) /
+                                   static_cast<double>(SDL_GetPerformanceFrequency());
+            return std::min(frames, start + static_cast<long long>(elapsed * deviceRate));
+        }
+
+        // 离线后端：在调用线程上算出 frames 帧交错双声道 s16。每块先处理命令、同步解码再混音，
+        // 输出只取决于之前调用的命令序列，和机器快慢无关
+        void render(short *out, int frames) {
+            if (backend != OFFLINE) {
+                return;
+            }
+            [[maybe_unused]] const DenormalGuard guard;
+            while (frames > 0) {
+                const int n = std::min(frames, FRAMES);
+                applyCommands();
+                // 两轮：被抢的通道第一轮回收，第二轮就能开始加载新文件，不用多等一块。
+                // 块中间到点的定时命令不会触发解码（定时开始的通道早就加载好了），跳转留到下一块
+                for (int pass = 0; pass < 2; ++pass) {
+                    for (int i = 0; i < voiceCount; ++i) {
+                        if (voices[i].active) {
+                            kick(voices[i]);
+                        }
+                    }
+                    service(renderBuffer);
+                }
+                mixTimed(out, n);
+                out += static_cast<ptrdiff_t>(n) * 2;
+                frames -= n;
+            }
+        }
+
+        // 通道用完时按策略抢一个优先级不高于 priority 的；文件由解码线程打开，打不开时会收到 FAILED 事件。
+        // time 为音频时钟上的开始帧：文件马上加载，到这一帧才开始出声，0 表示加载好就播
+        Handle open(const char *name, const int loop = 1, const int priority = 0, const long long time = 0) {
+            pump();
+            if (strlen(name) >= NAME_SIZE) {
+                printf("audio file name too long: %s\n", name);
+                return -1;
+            }
+            if (commands.writable() < 2) { // 抢通道时要多发一条 STOP
+                return -1;
+            }
+            const int i = findSlot(priority);
+            if (i == -1) {
+                ++stats.rejected;
+                return -1;
+            }
+            Slot &slot = slots[i];
+            slot.used = true;
+            slot.priority = priority;
+            slot.started = nextStart++;
+            push(Command::PLAY, i, slot.generation, static_cast<float>(loop), name, time);
+            return makeHandle(i, slot.generation);
+        }
+
+        // 句柄失效或命令环满时返回 false
+        bool close(const Handle handle) {
+            const int i = resolve(handle);
+            if (i == -1 || !push(Command::STOP, i, slots[i].generation, 0)) {
+                return false;
+            }
+            retire(i);
+            return true;
+        }
+
+        // 新建一条混进 parent 的总线，返回总线号；总线用完或 parent 还不存在时返回 -1。
+        // 总线建了就一直在，不用的可以把增益设成 0
+        int createBus(const int parent = 0) {
+            if (busCount == MAX_BUSES || parent < 0 || parent >= busCount) {
+                return -1;
+            }
+            const int bus = busCount;
+            allocateBus(buses[bus]); // 回调收到 BUS 之前不会碰这条总线
+            if (!push(Command::BUS, bus, 0, static_cast<float>(parent))) {
+                return -1;
+            }
+            busInfo[bus].parent = parent;
+            ++busCount;
+            return bus;
+        }
+
+        bool busGain(const int bus, const float gain) {
+            return bus >= 0 && bus < busCount && push(Command::BUS_GAIN, bus, 0, gain);
+        }
+
+        // 每条总线按 高通 -> 低通 -> 延迟 -> 混响 的固定顺序各有一个，参数：
+        // 高通/低通 (截止频率 Hz, Q)；延迟 (秒，不超过 MAX_DELAY_SECONDS, 反馈 0..0.95, 湿声比例)；
+        // 混响 (房间大小 0..1, 阻尼 0..1, 湿声比例)
+        bool busEffect(const int bus, const EffectType type, const bool enabled, const float a = 0, const float b = 0,
+                       const float c = 0) {
+            if (bus < 0 || bus >= busCount || type < 0 || type >= EFFECT_COUNT) {
+                return false;
+            }
+            Command command;
+            command.type = Command::EFFECT;
+            command.voice = bus;
+            command.value = enabled ? 1.0f : 0.0f;
+            command.effect = type;
+            command.params[0] = a;
+            command.params[1] = b;
+            command.params[2] = c;
+            if (!send(command)) {
+                return false;
+            }
+            busInfo[bus].effects[type] = enabled;
+            return true;
+        }
+
+        // 之后这个通道混进 bus；PLAY 时回到主总线
+        bool route(const Handle handle, const int bus) {
+            const int i = resolve(handle);
+            return i != -1 && bus >= 0 && bus < busCount &&
+                   push(Command::ROUTE, i, slots[i].generation, static_cast<float>(bus));
+        }
+
+        // 各总线从上次调用到现在的耗时
+        std::vector<BusStats> busStats() {
+            std::vector<BusStats> result(busCount);
+            const double toMs = 1000.0 / static_cast<double>(SDL_GetPerformanceFrequency());
+            for (int b = 0; b < busCount; ++b) {
+                BusInfo &info = busInfo[b];
+                const Uint64 ticks = buses[b].ticks.load(std::memory_order_relaxed);
+                const long long frames = buses[b].frames.load(std::memory_order_relaxed);
+                BusStats &stats = result[b];
+                stats.bus = b;
+                stats.parent = b == 0 ? -1 : info.parent;
+                std::copy(std::begin(info.effects), std::end(info.effects), std::begin(stats.effects));
+                stats.ms = static_cast<double>(ticks - info.lastTicks) * toMs;
+                if (frames > info.lastFrames) {
+                    stats.load = stats.ms / (static_cast<double>(frames - info.lastFrames) * 1000.0 / deviceRate);
+                }
+                info.lastTicks = ticks;
+                info.lastFrames = frames;
+            }
+            return result;
+        }
+
+        // 句柄还没播完、没被关掉或抢走
+        bool alive(const Handle handle) {
+            pump();
+            return resolve(handle) != -1;
+        }
+
+        // 到音频时钟的 time 帧停止；通道在停下后随 FINISHED 事件回收，句柄在那之前一直有效
+        bool stopAt(const Handle handle, const long long time) {
+            const int i = resolve(handle);
+            return i != -1 && push(Command::STOP, i, slots[i].generation, 0, nullptr, std::max(time, 1LL));
+        }
+
+        bool pause(const Handle handle, const int pause) {
+            const int i = resolve(handle);
+            return i != -1 && push(Command::PAUSE, i, slots[i].generation, static_cast<float>(pause));
+        }
+
+        bool volume(const Handle handle, const float gain, const long long time = 0) {
+            const int i = resolve(handle);
+            return i != -1 && push(Command::VOLUME, i, slots[i].generation, gain, nullptr, time);
+        }
+
+        bool seek(const Handle handle, const double seconds) {
+            const int i = resolve(handle);
+            if (i == -1) {
+                return false;
+            }
+            Command command;
+            command.type = Command::SEEK;
+            command.voice = i;
+            command.generation = slots[i].generation;
+            command.seconds = std::max(0.0, seconds);
+            return send(command);
+        }
+
+        // -1 最左，0 居中，1 最右
+        bool pan(const Handle handle, const float pan, const long long time = 0) {
+            const int i = resolve(handle);
+            return i != -1 && push(Command::PAN, i, slots[i].generation, pan, nullptr, time);
+        }
+
+        // 播放速度倍数，限制在 MIN_PITCH..MAX_PITCH
+        bool pitch(const Handle handle, const float pitch, const long long time = 0) {
+            const int i = resolve(handle);
+            return i != -1 && push(Command::PITCH, i, slots[i].generation, pitch, nullptr, time);
+        }
+
+        bool pause(const int pause) {
+            return push(Command::MASTER_PAUSE, -1, 0, static_cast<float>(pause));
+        }
+
+        bool poll(Event &event) {
+            pump();
+            if (events.empty()) {
+                return false;
+            }
+            event = events.front();
+            events.pop_front();
+            return true;
+        }
+
+        void setStealPolicy(const StealPolicy policy) {
+            stealPolicy = policy;
+        }
+
+        VoiceStats voiceStats() {
+            pump();
+            stats.total = voiceCount;
+            stats.droppedNotifications = droppedNotifications.load(std::memory_order_relaxed);
+            stats.starved = starved.load(std::memory_order_relaxed);
+            stats.lateCommands = lateCommands.load(std::memory_order_relaxed);
+            stats.used = static_cast<int>(std::count_if(slots.begin(), slots.end(),
+                                                        [](const Slot &slot) { return slot.used; }));
+            return stats;
+        }
+
+        // 不超过 seconds 秒的文件第一次播放时整段解码常驻，之后的播放不再解码；常驻的总量不超过 maxBytes
+        void setSampleLength(const double seconds, const size_t maxBytes) {
+            bank.setMaxSeconds(seconds);
+            bank.setMaxBytes(maxBytes);
+        }
+
+        SampleBank::Stats sampleStats() {
+            return bank.stats();
+        }
+
+        // 游戏线程尽快压 count 条空命令，回调照常混音时检查一条不丢、顺序不乱
+        StressResult stress(const long long count) {
+            StressResult result;
+            const long long processedBefore = processed.load();
+            const long long errorsBefore = errors.load();
+            const Uint64 start = SDL_GetPerformanceCounter();
+            const double toMs = 1000.0 / static_cast<double>(SDL_GetPerformanceFrequency());
+            const auto elapsed = [&] {
+                return static_cast<double>(SDL_GetPerformanceCounter() - start) * toMs;
+            };
+            // 设备没开时回调不会跑。回调每块才取一次命令，慢机器上总耗时说不准，所以只在它停着不动这么久时放弃
+            constexpr double STALL_MS = 2000;
+            long long seen = processedBefore;
+            Uint64 progress = start;
+            const auto stalled = [&] {
+                const long long now = processed.load();
+                if (now != seen) {
+                    seen = now;
+                    progress = SDL_GetPerformanceCounter();
+                }
+                return static_cast<double>(SDL_GetPerformanceCounter() - progress) * toMs > STALL_MS;
+            };
+            while (result.pushed < count && !stalled()) {
+                if (push(Command::PING, -1, 0, 0)) {
+                    ++result.pushed;
+                } else {
+                    ++result.fullSpins;
+                    std::this_thread::yield();
+                }
+            }
+            while (processed.load() - processedBefore < result.pushed && !stalled()) {
+                std::this_thread::yield();
+            }
+            result.processed = processed.load() - processedBefore;
+            result.errors = errors.load() - errorsBefore;
+            result.ms = elapsed();
+            return result;
+        }
+    };
+
+    Audio* gAudio;
+
+    // 一批发声体的距离衰减输入输出，各数组按 SoA 排、长度补齐到 4 的倍数
+    struct EmitterBatch {
+        const float *x;
+        const float *y;
+        const float *gain;
+        const float *near;     // 这个距离以内不衰减
+        const float *invRange; // 1 / (far - near)
+        const float *floor;    // near / far，反比曲线在 far 处减掉它正好为 0
+        const float *scale;    // 1 / (1 - floor)
+        const int *curve;
+        float *outGain;
+        float *outPan;
+    };
+
+    enum Rolloff {
+        ROLLOFF_LINEAR = 0,
+        ROLLOFF_INVERSE = 1,   // near / d，平移缩放到 far 处为 0
+        ROLLOFF_QUADRATIC = 2, // 线性的平方，近处更响、远处掉得快
+    };
+
+    void attenuateFrom(const EmitterBatch &batch, const float listenerX, const float listenerY,
+                       const float invPanWidth, const size_t begin, const size_t count) {
+        for (size_t i = begin; i < count; ++i) {
+            const float dx = batch.x[i] - listenerX;
+            const float dy = batch.y[i] - listenerY;
+            const float d = std::sqrt(dx * dx + dy * dy);
+            const float t = std::max(0.0f, std::min((d - batch.near[i]) * batch.invRange[i], 1.0f));
+            const float linear = 1.0f - t;
+            float g = linear;
+            if (batch.curve[i] == ROLLOFF_QUADRATIC) {
+                g = linear * linear;
+            } else if (batch.curve[i] == ROLLOFF_INVERSE) {
+                const float inverse = batch.near[i] / std::max(d, batch.near[i]);
+                g = std::max(0.0f, (inverse - batch.floor[i]) * batch.scale[i]);
+            }
+            batch.outGain[i] = batch.gain[i] * g;
+            batch.outPan[i] = std::max(-1.0f, std::min(dx * invPanWidth, 1.0f));
+        }
+    }
+
+#ifdef MIX_SSE2
+    // 一次四个发声体，三种曲线都算出来再按 curve 挑；运算顺序和标量版本一致
+    void attenuateSSE2(const EmitterBatch &batch, const float listenerX, const float listenerY,
+                       const float invPanWidth, const size_t count) {
+        const __m128 lx = _mm_set1_ps(listenerX);
+        const __m128 ly = _mm_set1_ps(listenerY);
+        const __m128 panScale = _mm_set1_ps(invPanWidth);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 minusOne = _mm_set1_ps(-1.0f);
+        const __m128i inverseCurve = _mm_set1_epi32(ROLLOFF_INVERSE);
+        const __m128i quadraticCurve = _mm_set1_epi32(ROLLOFF_QUADRATIC);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            const __m128 dx = _mm_sub_ps(_mm_loadu_ps(batch.x + i), lx);
+            const __m128 dy = _mm_sub_ps(_mm_loadu_ps(batch.y + i), ly);
+            const __m128 d = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+            const __m128 near = _mm_loadu_ps(batch.near + i);
+            const __m128 t = _mm_max_ps(zero, _mm_min_ps(_mm_mul_ps(_mm_sub_ps(d, near),
+                                                                     _mm_loadu_ps(batch.invRange + i)), one));
+            const __m128 linear = _mm_sub_ps(one, t);
+            const __m128 quadratic = _mm_mul_ps(linear, linear);
+            const __m128 inverse = _mm_max_ps(zero, _mm_mul_ps(
+                _mm_sub_ps(_mm_div_ps(near, _mm_max_ps(d, near)), _mm_loadu_ps(batch.floor + i)),
+                _mm_loadu_ps(batch.scale + i)));
+            const __m128i curve = _mm_loadu_si128(reinterpret_cast<const __m128i *>(batch.curve + i));
+            const __m128 isInverse = _mm_castsi128_ps(_mm_cmpeq_epi32(curve, inverseCurve));
+            const __m128 isQuadratic = _mm_castsi128_ps(_mm_cmpeq_epi32(curve, quadraticCurve));
+            __m128 g = _mm_or_ps(_mm_and_ps(isQuadratic, quadratic), _mm_andnot_ps(isQuadratic, linear));
+            g = _mm_or_ps(_mm_and_ps(isInverse, inverse), _mm_andnot_ps(isInverse, g));
+            _mm_storeu_ps(batch.outGain + i, _mm_mul_ps(_mm_loadu_ps(batch.gain + i), g));
+            _mm_storeu_ps(batch.outPan + i, _mm_max_ps(minusOne, _mm_min_ps(_mm_mul_ps(dx, panScale), one)));
+        }
+        attenuateFrom(batch, listenerX, listenerY, invPanWidth, i, count);
+    }
+#endif
+
+    // 世界坐标里的发声体。每帧 update() 批量算出所有发声体到听者的增益和声像，只把听得见的前 budget 个交给 Audio；
+    // 其余的是虚拟的：不占通道也不解码，只记着开始时间，重新听得见时按经过的时间接着放。
+    // 非循环的短音效没法知道还剩多少，虚拟化时直接丢弃。
+    // 实化一次要开通道，流式的还要跳转重解，所以进出都留余量：在边界上来回抖的发声体不会每帧开关一次
+    class AudioScene {
+    public:
+        static constexpr float AUDIBLE = 0.001f;  // 低于这个增益算听不见
+        static constexpr float EPSILON = 0.002f;  // 增益、声像变化小于它就不发命令
+        static constexpr float KEEP = 0.5f;       // 已经出声的降到 AUDIBLE * KEEP 以下才算听不见
+        static constexpr float HOLD = 1.5f;       // 抢预算时已经出声的增益按这么多倍算
+        static constexpr double MIN_VIRTUAL = 0.25; // 虚拟化后至少这么多秒才重新实化
+
+        struct Params {
+            int loop = 1;
+            float gain = 1.0f;
+            float near = 32.0f;
+            float far = 640.0f;
+            int curve = ROLLOFF_INVERSE;
+            int priority = 0;
+            int bus = 0;
+        };
+
+        struct Stats {
+            int emitters = 0;
+            int real = 0;
+            int virtualized = 0;
+            long long dropped = 0; // 没有通道或听不见而放弃的非循环发声体
+            double ms = 0;         // 上一次 update 的耗时
+        };
+
+    private:
+        // 只有 update 批量访问的热数据，按 SoA 排
+        std::vector<float> xs, ys, gains, nears, invRanges, floors, scales;
+        std::vector<int> curves;
+        std::vector<float> outGains, outPans;
+        // 冷数据
+        struct Info {
+            std::string name;
+            Params params;
+            bool playing = false;
+            bool wanted = false; // 这一帧挑中要出声
+            Audio::Handle handle = -1;
+            long long startClock = 0; // 开始时的音频时钟，重新实化时据此跳转
+            long long virtualUntil = 0; // 音频时钟到这里之前不重新实化
+            float sentGain = -1.0f;
+            float sentPan = 0.0f;
+        };
+        std::vector<Info> infos;
+        std::vector<int> freeIds;
+        std::vector<int> candidates;
+        Audio &audio;
+        float listenerX = 0;
+        float listenerY = 0;
+        float panWidth = 320.0f; // 横向差这么多就完全偏到一边
+        int budget = 32;
+        Stats counters;
+
+        void configure(const int id, const Params &params) {
+            const float near = std::max(params.near, 0.001f);
+            const float far = std::max(params.far, near + 0.001f);
+            gains[id] = std::max(0.0f, params.gain);
+            nears[id] = near;
+            invRanges[id] = 1.0f / (far - near);
+            floors[id] = near / far;
+            scales[id] = 1.0f / (1.0f - near / far);
+            curves[id] = params.curve;
+            infos[id].params = params;
+        }
+
+        void grow() {
+            const size_t count = infos.size() + 4; // 保持 4 的倍数，SIMD 不用处理尾巴
+            for (auto *v: {&xs, &ys, &gains, &nears, &invRanges, &floors, &scales, &outGains, &outPans}) {
+                v->resize(count, 0.0f);
+            }
+            std::fill(invRanges.end() - 4, invRanges.end(), 1.0f);
+            std::fill(nears.end() - 4, nears.end(), 1.0f);
+            curves.resize(count, ROLLOFF_LINEAR);
+            for (size_t i = infos.size(); i < count; ++i) {
+                freeIds.push_back(static_cast<int>(count - 1 - (i - infos.size())));
+            }
+            infos.resize(count);
+        }
+
+        void silence(Info &info) {
+            if (info.handle != -1) {
+                audio.close(info.handle);
+                info.handle = -1;
+            }
+        }
+
+        bool realize(const int id) {
+            Info &info = infos[id];
+            const Audio::Handle handle = audio.open(info.name.c_str(), info.params.loop, info.params.priority);
+            if (handle == -1) {
+                return false;
+            }
+            // 刚创建的直接从头放，省得流式的为几毫秒重新解一遍
+            const long long elapsed = audio.position() - info.startClock;
+            if (elapsed > audio.sampleRate() / 10) {
+                audio.seek(handle, static_cast<double>(elapsed) / audio.sampleRate());
+            }
+            if (info.params.bus != 0) {
+                audio.route(handle, info.params.bus);
+            }
+            info.handle = handle;
+            info.sentGain = -1.0f;
+            return true;
+        }
+
+    public:
+        explicit AudioScene(Audio &audio) : audio(audio) {
+        }
+
+        AudioScene(const AudioScene &) = delete;
+        AudioScene &operator=(const AudioScene &) = delete;
+
+        ~AudioScene() {
+            for (Info &info: infos) {
+                silence(info);
+            }
+        }
+
+        // 创建后立即开始播放（下一次 update 时才决定是否真的占通道）
+        int add(const char *name, const float x, const float y, const Params &params) {
+            if (freeIds.empty()) {
+                grow();
+            }
+            const int id = freeIds.back();
+            freeIds.pop_back();
+            Info &info = infos[id];
+            info = Info{};
+            info.name = name;
+            info.playing = true;
+            info.startClock = audio.position();
+            xs[id] = x;
+            ys[id] = y;
+            configure(id, params);
+            ++counters.emitters;
+            return id;
+        }
+
+        void remove(const int id) {
+            Info &info = infos[id];
+            silence(info);
+            info = Info{};
+            gains[id] = 0.0f;
+            freeIds.push_back(id);
+            --counters.emitters;
+        }
+
+        void move(const int id, const float x, const float y) {
+            xs[id] = x;
+            ys[id] = y;
+        }
+
+        void set(const int id, const Params &params) {
+            configure(id, params);
+        }
+
+        [[nodiscard]] Params params(const int id) const {
+            return infos[id].params;
+        }
+
+        void stop(const int id) {
+            silence(infos[id]);
+            infos[id].playing = false;
+        }
+
+        [[nodiscard]] bool playing(const int id) const { return infos[id].playing; }
+
+        [[nodiscard]] bool real(const int id) const { return infos[id].handle != -1; }
+
+        [[nodiscard]] float gain(const int id) const { return outGains[id]; }
+
+        [[nodiscard]] float pan(const int id) const { return outPans[id]; }
+
+        void setListener(const float x, const float y, const float width) {
+            listenerX = x;
+            listenerY = y;
+            panWidth = std::max(width, 1.0f);
+        }
+
+        void setBudget(const int n) {
+            budget = std::max(0, n);
+        }
+
+        [[nodiscard]] Stats stats() const { return counters; }
+
+        // 只算增益和声像，不动通道；基准测试也用它
+        void attenuate() {
+            const EmitterBatch batch{xs.data(), ys.data(), gains.data(), nears.data(), invRanges.data(),
+                                     floors.data(), scales.data(), curves.data(), outGains.data(), outPans.data()};
+#ifdef MIX_SSE2
+            attenuateSSE2(batch, listenerX, listenerY, 1.0f / panWidth, infos.size());
+#else
+            attenuateFrom(batch, listenerX, listenerY, 1.0f / panWidth, 0, infos.size());
+#endif
+        }
+
+        // 每帧一次：收回播完的，算衰减，挑出最该出声的 budget 个，其余虚拟化
+        void update() {
+            const Uint64 start = SDL_GetPerformanceCounter();
+            for (Info &info: infos) {
+                if (info.handle != -1 && !audio.alive(info.handle)) {
+                    info.handle = -1;
+                    if (!info.params.loop) { // 播完、失败或被抢走
+                        info.playing = false;
+                    }
+                }
+            }
+            attenuate();
+
+            candidates.clear();
+            const long long now = audio.position();
+            for (size_t i = 0; i < infos.size(); ++i) {
+                const Info &info = infos[i];
+                if (!info.playing) {
+                    continue;
+                }
+                if (info.handle != -1 ? outGains[i] >= AUDIBLE * KEEP
+                                      : outGains[i] >= AUDIBLE && now >= info.virtualUntil) {
+                    candidates.push_back(static_cast<int>(i));
+                }
+            }
+            const auto weight = [this](const int id) {
+                return infos[id].handle != -1 ? outGains[id] * HOLD : outGains[id];
+            };
+            const auto louder = [this, &weight](const int a, const int b) {
+                if (infos[a].params.priority != infos[b].params.priority) {
+                    return infos[a].params.priority > infos[b].params.priority;
+                }
+                return weight(a) > weight(b);
+            };
+            const size_t wanted = std::min(candidates.size(), static_cast<size_t>(budget));
+            std::nth_element(candidates.begin(), candidates.begin() + wanted, candidates.end(), louder);
+            for (Info &info: infos) {
+                info.wanted = false;
+            }
+            for (size_t k = 0; k < wanted; ++k) {
+                infos[candidates[k]].wanted = true;
+            }
+
+            // 先让出通道再占，同一帧里换人不会互相抢
+            counters.real = 0;
+            counters.virtualized = 0;
+            const long long hold = static_cast<long long>(MIN_VIRTUAL * audio.sampleRate());
+            for (Info &info: infos) {
+                if (!info.playing || info.wanted) {
+                    continue;
+                }
+                if (info.handle != -1) {
+                    silence(info);
+                    info.virtualUntil = now + hold;
+                }
+                if (!info.params.loop) {
+                    info.playing = false;
+                    ++counters.dropped;
+                } else {
+                    ++counters.virtualized;
+                }
+            }
+            for (size_t k = 0; k < wanted; ++k) {
+                const int id = candidates[k];
+                Info &info = infos[id];
+                if (info.handle == -1 && !realize(id)) {
+                    if (!info.params.loop) {
+                        info.playing = false;
+                        ++counters.dropped;
+                    } else {
+                        info.virtualUntil = now + hold;
+                        ++counters.virtualized;
+                    }
+                    continue;
+                }
+                ++counters.real;
+                if (std::fabs(outGains[id] - info.sentGain) > EPSILON ||
+                    std::fabs(outPans[id] - info.sentPan) > EPSILON) {
+                    if (audio.volume(info.handle, outGains[id]) && audio.pan(info.handle, outPans[id])) {
+                        info.sentGain = outGains[id];
+                        info.sentPan = outPans[id];
+                    }
+                }
+            }
+            const double toMs = 1000.0 / static_cast<double>(SDL_GetPerformanceFrequency());
+            counters.ms = static_cast<double>(SDL_GetPerformanceCounter() - start) * toMs;
+        }
+    };
+
+    AudioScene *gAudioScene;
+
+    int lua_error_callback(lua_State *L) {
+        const char *error = lua_tostring(L, 1);
+        luaL_traceback(L, L, error, 0);
+        return 1;
+    }
+
+    std::string moduleFile(const char *module) {
+        std::string name = module;
+        for (size_t i = 0; i < name.size(); ++i) {
+            if (name[i] == '.') { // 不能用双引号：""自带\0，要用''
+                name[i] = '/';
+            }
+        }
+        name += ".lua";
+        return name;
+    }
+
+    // 找 name 旁边的预编译块并加载，成功时 ret 为 luaL_loadbufferx 的结果。
+    // Lua 版本不同、源码改过（CRC 或长度对不上）或字节码加载失败而有源码可退时返回 false
+    bool loadCompiled(lua_State *L, const std::string &name, int &ret) {
+        const std::string compiled = name + luac::SUFFIX;
+        Zip::Blob chunk = gZip->read(compiled.c_str());
+        luac::Header header{};
+        if (!chunk || chunk.size() < sizeof(header)) {
+            return false;
+        }
+        memcpy(&header, chunk.data(), sizeof(header));
+        if (memcmp(header.magic, luac::MAGIC, sizeof(header.magic)) != 0 || header.luaVersion != LUA_VERSION_NUM) {
+            return false;
+        }
+        Zip::Stat source{};
+        const bool hasSource = gZip->stat(name.c_str(), source);
+        if (hasSource && (source.crc32 != header.sourceCrc || source.size != header.sourceSize)) {
+            return false;
+        }
+        ret = luaL_loadbufferx(L, reinterpret_cast<const char *>(chunk.data() + sizeof(header)),
+                               chunk.size() - sizeof(header), name.c_str(), "b");
+        if (ret != 0 && hasSource) {
+            lua_pop(L, 1);
+            return false;
+        }
+        return true;
+    }
+
+    int lua_ziploader(lua_State* L) {
+        // 由 lua_zipsearcher 找到时第二个参数就是文件名
+        std::string name = lua_isstring(L, 2) ? lua_tostring(L, 2) : moduleFile(luaL_checkstring(L, 1));
+        lua_pushcfunction(L, lua_error_callback);
+        int ret;
+        if (const pack::Entry *entry = findPacked(name.c_str(), pack::LUA)) {
+            // 资源包里只有字节码，不接受源码
+            ret = luaL_loadbufferx(L, reinterpret_cast<const char *>(gPack->data(*entry)), entry->size,
+                                   name.c_str(), "b");
+        } else if (!loadCompiled(L, name, ret)) {
+            Zip::Blob source = gZip->read(name.c_str());
+            if (!source) {
+                luaL_error(L, "%s not found!", name.c_str());
+                return 0;
+            }
+            ret = luaL_loadbuffer(L, reinterpret_cast<const char *>(source.data()), source.size(), name.c_str());
+        }
+        if (ret == 0) {
+            ret = lua_pcall(L, 0, 1, -2);
+        }
+        if (ret) {
+            printf("%s\n", lua_tostring(L, -1));
+        }
+        return 1;
+    }
+    // package.searchers 的一项：查哈希索引，找到才返回 loader
+    int lua_zipsearcher(lua_State *L) {
+        const std::string name = moduleFile(luaL_checkstring(L, 1));
+        if (!findPacked(name.c_str(), pack::LUA) && !gZip->exists(name.c_str()) &&
+            !gZip->exists((name + luac::SUFFIX).c_str())) {
+            lua_pushfstring(L, "no file '%s' in zip", name.c_str());
+            return 1;
+        }
+        lua_pushcfunction(L, lua_ziploader);
+        lua_pushstring(L, name.c_str());
+        return 2;
+    }
+
+    int lua_zipExists(lua_State *L) {
+        lua_pushboolean(L, gZip->exists(luaL_checkstring(L, 1)));
+        return 1;
+    }
+
+    // zipStat(name) -> {size=, compressedSize=, directory=}，不存在时返回 nil
+    int lua_zipStat(lua_State *L) {
+        Zip::Stat stat{};
+        if (!gZip->stat(luaL_checkstring(L, 1), stat)) {
+            lua_pushnil(L);
+            return 1;
+        }
+        lua_createtable(L, 0, 3);
+        lua_pushinteger(L, static_cast<lua_Integer>(stat.size));
+        lua_setfield(L, -2, "size");
+        lua_pushinteger(L, static_cast<lua_Integer>(stat.compressedSize));
+        lua_setfield(L, -2, "compressedSize");
+        lua_pushboolean(L, stat.directory);
+        lua_setfield(L, -2, "directory");
+        return 1;
+    }
+
+    int lua_zipList(lua_State *L) {
+        const auto names = gZip->list(luaL_optstring(L, 1, ""));
+        lua_createtable(L, static_cast<int>(names.size()), 0);
+        for (size_t i = 0; i < names.size(); ++i) {
+            lua_pushstring(L, names[i].c_str());
+            lua_rawseti(L, -2, static_cast<lua_Integer>(i + 1));
+        }
+        return 1;
+    }
+
+    int lua_glClearColor(lua_State *L) {
+        glClearColor(static_cast<GLfloat>(luaL_checknumber(L, 1)),
+                     static_cast<GLfloat>(luaL_checknumber(L, 2)),
+                     static_cast<GLfloat>(luaL_checknumber(L, 3)),
+                     static_cast<GLfloat>(luaL_checknumber(L, 4)));
+        return 0;
+    }
+
+    int lua_glClear(lua_State *L) {
+        glClear(static_cast<GLbitfield>(luaL_checkinteger(L, 1)));
+        return 0;
+    }
+
+    int lua_glViewport(lua_State *L) {
+        gState.setViewport(static_cast<GLint>(luaL_checkinteger(L, 1)),
+                           static_cast<GLint>(luaL_checkinteger(L, 2)),
+                           static_cast<GLsizei>(luaL_checkinteger(L, 3)),
+                           static_cast<GLsizei>(luaL_checkinteger(L, 4)));
+        return 0;
+    }
+
+    int lua_glDrawArrays(lua_State *L) {
+        auto mode = static_cast<GLenum>(luaL_checkinteger(L, 1));
+        auto first = static_cast<GLint>(luaL_checkinteger(L, 2));
+        auto count = static_cast<GLsizei>(luaL_checkinteger(L, 3));
+        glDrawArrays(mode, first, count);
+        return 0;
+    }
+    int lua_glEnable(lua_State* L) {
+        auto cap = static_cast<GLenum>(luaL_checkinteger(L, 1));
+        if (cap == GL_BLEND) {
+            gState.setBlend(true);
+        } else {
+            glEnable(cap);
+        }
+        return 0;
+    }
+    int lua_glDisable(lua_State* L) {
+        auto cap = static_cast<GLenum>(luaL_checkinteger(L, 1));
+        if (cap == GL_BLEND) {
+            gState.setBlend(false);
+        } else {
+            glDisable(cap);
+        }
+        return 0;
+    }
+    int lua_glBlendFunc(lua_State* L) {
+        auto sfactor = static_cast<GLenum>(luaL_checkinteger(L, 1));
+        auto dfactor = static_cast<GLenum>(luaL_checkinteger(L, 2));
+        gState.blendFunc(sfactor, dfactor);
+        return 0;
+    }
+    template<typename T>
+    void pushObject(lua_State *L, T *obj, const char *name) {
+        auto **udata = static_cast<T **>(lua_newuserdata(L, sizeof(T**)));
+        *udata = obj;
+        luaL_getmetatable(L, name);
+        lua_setmetatable(L, -2);
+    }
+
+    int lua_newShader(lua_State *L) {
+        const char *vsSrc = luaL_checkstring(L, 1);
+        const char *fsSrc = luaL_checkstring(L, 2);
+        auto *shader = new Shader(vsSrc, fsSrc);
+        pushObject(L, shader, "Shader");
+        return 1;
+    }
+
+    int lua_newBuffer(lua_State *L) {
+        Buffer *buffer;
+        if (lua_istable(L, 1)) {
+            std::vector<float> point;
+            const size_t len = lua_rawlen(L, 1);
+            point.resize(len);
+            for (size_t i = 1; i <= len; ++i) {
+                lua_rawgeti(L, 1, i);
+
+                point[i - 1] = static_cast<float>(lua_tonumber(L, -1));
+                lua_pop(L, 1);
+            }
+            buffer = new Buffer(point);
+        } else {
+            const auto x = static_cast<float>(luaL_checknumber(L, 1));
+            const auto y = static_cast<float>(luaL_checknumber(L, 2));
+            const auto w = static_cast<float>(luaL_checknumber(L, 3));
+            const auto h = static_cast<float>(luaL_checknumber(L, 4));
+            const bool uv = lua_isnone(L, 5) ? true : lua_toboolean(L, 5);
+            buffer = new Buffer(x, y, w, h, uv);
+        }
+        pushObject(L, buffer, "Buffer");
+        return 1;
+    }
+
+    int lua_newTexture(lua_State *L) {
+        Texture* texture;
+        if (lua_gettop(L) == 1) {
+            const char *name = luaL_checkstring(L, 1);
+            texture = gResources->acquireTexture(name);
+
+        }else {
+            std::vector<unsigned char> bitmap;
+            size_t size;
+            const char* p = luaL_checklstring(L, 1, &size);
+            bitmap.resize(size);
+            memcpy(bitmap.data(), p, size);
+            const int w = static_cast<int>(luaL_checkinteger(L, 2));
+            const int h = static_cast<int>(luaL_checkinteger(L, 3));
+            texture = new Texture(bitmap, w, h);
+        }
+        pushObject(L, texture, "Texture");
+        return 1;
+    }
+
+    int lua_newFont(lua_State* L) {
+        const char* name = luaL_checkstring(L, 1);
+        auto* font = gResources->acquireFont(name);
+        pushObject(L, font, "Font");
+        return 1;
+    }
+
+    int lua_newSpriteBatch(lua_State *L) {
+        const auto capacity = static_cast<int>(luaL_optinteger(L, 1, 4096));
+        auto *batch = new SpriteBatch(capacity);
+        pushObject(L, batch, "SpriteBatch");
+        return 1;
+    }
+
+    // newMesh(buffer, shader, {{"position", 2, GL_FLOAT, stride, offset, normalized}, ...})
+    int lua_newMesh(lua_State *L) {
+        auto **buffer = static_cast<Buffer **>(luaL_checkudata(L, 1, "Buffer"));
+        auto **shader = static_cast<Shader **>(luaL_checkudata(L, 2, "Shader"));
+        luaL_checktype(L, 3, LUA_TTABLE);
+        std::vector<VertexAttrib> layout;
+        const size_t len = lua_rawlen(L, 3);
+        for (size_t i = 1; i <= len; ++i) {
+            lua_rawgeti(L, 3, static_cast<lua_Integer>(i));
+            luaL_checktype(L, -1, LUA_TTABLE);
+            VertexAttrib attrib;
+            lua_rawgeti(L, -1, 1);
+            attrib.name = luaL_checkstring(L, -1);
+            lua_rawgeti(L, -2, 2);
+            attrib.size = static_cast<GLint>(luaL_checkinteger(L, -1));
+            lua_rawgeti(L, -3, 3);
+            attrib.type = static_cast<GLenum>(luaL_checkinteger(L, -1));
+            lua_rawgeti(L, -4, 4);
+            attrib.stride = static_cast<GLsizei>(lua_tointeger(L, -1));
+            lua_rawgeti(L, -5, 5);
+            attrib.offset = static_cast<size_t>(lua_tointeger(L, -1));
+            lua_rawgeti(L, -6, 6);
+            attrib.normalized = lua_toboolean(L, -1) ? GL_TRUE : GL_FALSE;
+            lua_pop(L, 7);
+            layout.push_back(attrib);
+        }
+        auto *mesh = new Mesh(**buffer, **shader, layout);
+        pushObject(L, mesh, "Mesh");
+        // VAO 引用着 buffer，让 mesh 持有它们
+        lua_createtable(L, 2, 0);
+        lua_pushvalue(L, 1);
+        lua_rawseti(L, -2, 1);
+        lua_pushvalue(L, 2);
+        lua_rawseti(L, -2, 2);
+        lua_setiuservalue(L, -2, 1);
+        return 1;
+    }
+
+    int lua_newInstanceBuffer(lua_State *L) {
+        const auto capacity = static_cast<int>(luaL_optinteger(L, 1, 256));
+        auto *buffer = new InstanceBuffer(capacity);
+        pushObject(L, buffer, "InstanceBuffer");
+        return 1;
+    }
+
+    // drawRectsInstanced(instances [, shader])
+    int lua_drawRectsInstanced(lua_State *L) {
+        auto **udata = static_cast<InstanceBuffer **>(luaL_checkudata(L, 1, "InstanceBuffer"));
+        const Shader *shader = gRectShader;
+        if (!lua_isnoneornil(L, 2)) {
+            shader = *static_cast<Shader **>(luaL_checkudata(L, 2, "Shader"));
+        }
+        (*udata)->draw(*shader);
+        return 0;
+    }
+
+    int lua_newAtlas(lua_State *L) {
+        const lua_Integer pageSize = luaL_optinteger(L, 1, 1024);
+        const lua_Integer padding = luaL_optinteger(L, 2, 1);
+        luaL_argcheck(L, pageSize > 0, 1, "page size must be positive");
+        luaL_argcheck(L, padding >= 0, 2, "padding must not be negative");
+        auto *atlas = new Atlas(static_cast<int>(std::min<lua_Integer>(pageSize, maxTextureSize())),
+                                static_cast<int>(std::min<lua_Integer>(padding, pageSize)));
+        pushObject(L, atlas, "Atlas");
+        return 1;
+    }
+
+    int lua_getFrameStats(lua_State *L) {
+        lua_createtable(L, 0, 4);
+        lua_pushinteger(L, gLastFrameStats.drawCalls);
+        lua_setfield(L, -2, "drawCalls");
+        lua_pushinteger(L, gLastFrameStats.sprites);
+        lua_setfield(L, -2, "sprites");
+        lua_pushinteger(L, gLastFrameStats.stateCalls);
+        lua_setfield(L, -2, "stateCalls");
+        lua_pushinteger(L, gLastFrameStats.stateElided);
+        lua_setfield(L, -2, "stateElided");
+        return 1;
+    }
+
+    int lua_loadTextureAsync(lua_State *L) {
+        const char *name = luaL_checkstring(L, 1);
+        auto *future = new AssetFuture{gLoader->request(Loader::TEXTURE, name)};
+        pushObject(L, future, "AssetFuture");
+        return 1;
+    }
+
+    int lua_loadFontAsync(lua_State *L) {
+        const char *name = luaL_checkstring(L, 1);
+        auto *future = new AssetFuture{gLoader->request(Loader::FONT, name)};
+        pushObject(L, future, "AssetFuture");
+        return 1;
+    }
+
+    int lua_resourceStats(lua_State *L) {
+        gResources->pushStats(L);
+        return 1;
+    }
+
+    // setResourceBudget(cpuBytes, gpuBytes)
+    int lua_setResourceBudget(lua_State *L) {
+        gResources->setBudget(static_cast<size_t>(luaL_checkinteger(L, 1)),
+                              static_cast<size_t>(luaL_checkinteger(L, 2)));
+        return 0;
+    }
+
+    int lua_setLoadBudget(lua_State *L) {
+        gLoader->setBudget(luaL_checknumber(L, 1));
+        return 0;
+    }
+
+    // audioOpen(name, [loop], [priority]) -> 句柄，失败为 -1
+    int lua_audioOpen(lua_State* L) {
+        const char* name = luaL_checkstring(L, 1);
+        int loop = lua_isnone(L, 2) ? 1 : luaL_checkinteger(L, 2);
+        const auto priority = static_cast<int>(luaL_optinteger(L, 3, 0));
+        lua_pushinteger(L, gAudio->open(name, loop, priority));
+        return 1;
+    }
+
+    int lua_audioClose(lua_State* L) {
+        lua_pushboolean(L, gAudio->close(luaL_checkinteger(L, 1)));
+        return 1;
+    }
+
+    // audioPause(pause) 暂停全部；audioPause(handle, pause) 暂停一个通道
+    int lua_audioPause(lua_State* L) {
+        bool ok;
+        if (lua_gettop(L) >= 2) {
+            ok = gAudio->pause(luaL_checkinteger(L, 1), static_cast<int>(luaL_checkinteger(L, 2)));
+        } else {
+            ok = gAudio->pause(static_cast<int>(luaL_checkinteger(L, 1)));
+        }
+        lua_pushboolean(L, ok);
+        return 1;
+    }
+
+    int lua_audioVolume(lua_State *L) {
+        lua_pushboolean(L, gAudio->volume(luaL_checkinteger(L, 1), static_cast<float>(luaL_checknumber(L, 2))));
+        return 1;
+    }
+
+    // 按 index 处的 {gain=, pan=, pitch=} 改通道参数，只改给出的字段
+    bool setVoice(lua_State *L, const Audio::Handle handle, const int index, const long long time) {
+        luaL_checktype(L, index, LUA_TTABLE);
+        bool ok = true;
+        if (lua_getfield(L, index, "gain") != LUA_TNIL) {
+            ok = gAudio->volume(handle, static_cast<float>(luaL_checknumber(L, -1)), time) && ok;
+        }
+        if (lua_getfield(L, index, "pan") != LUA_TNIL) {
+            ok = gAudio->pan(handle, static_cast<float>(luaL_checknumber(L, -1)), time) && ok;
+        }
+        if (lua_getfield(L, index, "pitch") != LUA_TNIL) {
+            ok = gAudio->pitch(handle, static_cast<float>(luaL_checknumber(L, -1)), time) && ok;
+        }
+        lua_pop(L, 3);
+        return ok;
+    }
+
+    // audioSet(handle, {gain=, pan=, pitch=})
+    int lua_audioSet(lua_State *L) {
+        lua_pushboolean(L, setVoice(L, luaL_checkinteger(L, 1), 2, 0));
+        return 1;
+    }
+
+    // audioScheduleAt(clip, sampleTime, [loop], [priority]) -> 句柄：马上加载，在音频时钟的 sampleTime 帧开始出声
+    int lua_audioScheduleAt(lua_State *L) {
+        const char *name = luaL_checkstring(L, 1);
+        const lua_Integer time = luaL_checkinteger(L, 2);
+        const auto loop = static_cast<int>(luaL_optinteger(L, 3, 0));
+        const auto priority = static_cast<int>(luaL_optinteger(L, 4, 0));
+        lua_pushinteger(L, gAudio->open(name, loop, priority, time));
         return 1;
     }
-    int lua_glClearColor(lua_State *L) {
-        glClearColor(static_cast<GLfloat>(luaL_checknumber(L, 1)),
-                     static_cast<GLfloat>(luaL_checknumber(L, 2)),
-                     static_cast<GLfloat>(luaL_checknumber(L, 3)),
-                     static_cast<GLfloat>(luaL_checknumber(L, 4)));
-        return 0;
+
+    // audioStopAt(handle, sampleTime)
+    int lua_audioStopAt(lua_State *L) {
+        lua_pushboolean(L, gAudio->stopAt(luaL_checkinteger(L, 1), luaL_checkinteger(L, 2)));
+        return 1;
     }
 
-    int lua_glClear(lua_State *L) {
-        glClear(static_cast<GLbitfield>(luaL_checkinteger(L, 1)));
-        return 0;
+    // audioSetAt(handle, sampleTime, {gain=, pan=, pitch=})
+    int lua_audioSetAt(lua_State *L) {
+        lua_pushboolean(L, setVoice(L, luaL_checkinteger(L, 1), 3, luaL_checkinteger(L, 2)));
+        return 1;
     }
 
-    int lua_glViewport(lua_State *L) {
-        glViewport(static_cast<GLint>(luaL_checkinteger(L, 1)),
-                   static_cast<GLint>(luaL_checkinteger(L, 2)),
-                   static_cast<GLsizei>(luaL_checkinteger(L, 3)),
-                   static_cast<GLsizei>(luaL_checkinteger(L, 4)));
-        return 0;
+    // audioTime() -> 正在出声的帧在音频时钟上的位置, 采样率
+    int lua_audioTime(lua_State *L) {
+        lua_pushinteger(L, gAudio->position());
+        lua_pushinteger(L, gAudio->sampleRate());
+        return 2;
     }
 
-    int lua_glDrawArrays(lua_State *L) {
-        auto mode = static_cast<GLenum>(luaL_checkinteger(L, 1));
-        auto first = static_cast<GLint>(luaL_checkinteger(L, 2));
-        auto count = static_cast<GLsizei>(luaL_checkinteger(L, 3));
-        glDrawArrays(mode, first, count);
-        return 0;
+    // audioSeek(handle, seconds)
+    int lua_audioSeek(lua_State *L) {
+        lua_pushboolean(L, gAudio->seek(luaL_checkinteger(L, 1), luaL_checknumber(L, 2)));
+        return 1;
     }
-    int lua_glEnable(lua_State* L) {
-        auto cap = static_cast<GLenum>(luaL_checkinteger(L, 1));
-        glEnable(cap);
+
+    // audioSetStealPolicy("none" | "oldest" | "lowest")
+    int lua_audioSetStealPolicy(lua_State *L) {
+        static const char *const names[] = {"none", "oldest", "lowest", nullptr};
+        gAudio->setStealPolicy(static_cast<Audio::StealPolicy>(luaL_checkoption(L, 1, nullptr, names)));
         return 0;
     }
-    int lua_glDisable(lua_State* L) {
-        auto cap = static_cast<GLenum>(luaL_checkinteger(L, 1));
-        glDisable(cap);
-        return 0;
+
+    // audioVoices() -> {total=, used=, stolen=, rejected=, droppedNotifications=, starved=, lateCommands=}
+    int lua_audioVoices(lua_State *L) {
+        const Audio::VoiceStats stats = gAudio->voiceStats();
+        lua_createtable(L, 0, 7);
+        lua_pushinteger(L, stats.total);
+        lua_setfield(L, -2, "total");
+        lua_pushinteger(L, stats.used);
+        lua_setfield(L, -2, "used");
+        lua_pushinteger(L, stats.stolen);
+        lua_setfield(L, -2, "stolen");
+        lua_pushinteger(L, stats.rejected);
+        lua_setfield(L, -2, "rejected");
+        lua_pushinteger(L, stats.droppedNotifications);
+        lua_setfield(L, -2, "droppedNotifications");
+        lua_pushinteger(L, stats.starved);
+        lua_setfield(L, -2, "starved");
+        lua_pushinteger(L, stats.lateCommands);
+        lua_setfield(L, -2, "lateCommands");
+        return 1;
     }
-    int lua_glBlendFunc(lua_State* L) {
-        auto sfactor = static_cast<GLenum>(luaL_checkinteger(L, 1));
-        auto dfactor = static_cast<GLenum>(luaL_checkinteger(L, 2));
-        glBlendFunc(sfactor, dfactor);
+
+    // audioSetSampleLength(seconds, [megabytes=64]) 不超过这个长度的音效解码一次后常驻内存，
+    // 总量超过 megabytes 时淘汰最久没放的
+    int lua_audioSetSampleLength(lua_State *L) {
+        const lua_Number megabytes = luaL_optnumber(L, 2, 64);
+        luaL_argcheck(L, megabytes >= 0, 2, "megabytes must be >= 0");
+        gAudio->setSampleLength(luaL_checknumber(L, 1), static_cast<size_t>(megabytes * (1 << 20)));
         return 0;
     }
-    template<typename T>
-    void pushObject(lua_State *L, T *obj, const char *name) {
-        auto **udata = static_cast<T **>(lua_newuserdata(L, sizeof(T**)));
-        *udata = obj;
-        luaL_getmetatable(L, name);
-        lua_setmetatable(L, -2);
+
+    // audioSamples() -> {clips=, streamed=, bytes=, maxBytes=, hits=, misses=, evictions=, maxSeconds=}
+    int lua_audioSamples(lua_State *L) {
+        const SampleBank::Stats stats = gAudio->sampleStats();
+        lua_createtable(L, 0, 8);
+        lua_pushinteger(L, stats.clips);
+        lua_setfield(L, -2, "clips");
+        lua_pushinteger(L, stats.streamed);
+        lua_setfield(L, -2, "streamed");
+        lua_pushinteger(L, static_cast<lua_Integer>(stats.bytes));
+        lua_setfield(L, -2, "bytes");
+        lua_pushinteger(L, static_cast<lua_Integer>(stats.maxBytes));
+        lua_setfield(L, -2, "maxBytes");
+        lua_pushinteger(L, stats.hits);
+        lua_setfield(L, -2, "hits");
+        lua_pushinteger(L, stats.misses);
+        lua_setfield(L, -2, "misses");
+        lua_pushinteger(L, stats.evictions);
+        lua_setfield(L, -2, "evictions");
+        lua_pushnumber(L, stats.maxSeconds);
+        lua_setfield(L, -2, "maxSeconds");
+        return 1;
     }
 
-    int lua_newShader(lua_State *L) {
-        const char *vsSrc = luaL_checkstring(L, 1);
-        const char *fsSrc = luaL_checkstring(L, 2);
-        auto *shader = new Shader(vsSrc, fsSrc);
-        pushObject(L, shader, "Shader");
+    // 取出混音线程报上来的事件：{ {voice=句柄, event="finished"|"failed"}, ... }
+    int lua_audioEvents(lua_State *L) {
+        lua_newtable(L);
+        Audio::Event event{};
+        lua_Integer n = 0;
+        while (gAudio->poll(event)) {
+            lua_createtable(L, 0, 2);
+            lua_pushinteger(L, event.handle);
+            lua_setfield(L, -2, "voice");
+            lua_pushstring(L, event.type == Audio::Notification::FINISHED ? "finished" : "failed");
+            lua_setfield(L, -2, "event");
+            lua_rawseti(L, -2, ++n);
+        }
         return 1;
     }
 
-    int lua_newBuffer(lua_State *L) {
-        Buffer *buffer;
-        if (lua_istable(L, 1)) {
-            std::vector<float> point;
-            const size_t len = lua_rawlen(L, 1);
-            point.resize(len);
-            for (size_t i = 1; i <= len; ++i) {
-                lua_rawgeti(L, 1, i);
+    double readNumber(lua_State *L, const int index, const char *field, const double def) {
+        lua_getfield(L, index, field);
+        const double value = lua_isnil(L, -1) ? def : lua_tonumber(L, -1);
+        lua_pop(L, 1);
+        return value;
+    }
 
-                point[i - 1] = static_cast<float>(lua_tonumber(L, -1));
-                lua_pop(L, 1);
-            }
-            buffer = new Buffer(point);
+    // audioBus([parent=0]) -> 总线号，总线用完时返回 nil
+    int lua_audioBus(lua_State *L) {
+        const int bus = gAudio->createBus(static_cast<int>(luaL_optinteger(L, 1, 0)));
+        if (bus == -1) {
+            lua_pushnil(L);
         } else {
-            const auto x = static_cast<float>(luaL_checknumber(L, 1));
-            const auto y = static_cast<float>(luaL_checknumber(L, 2));
-            const auto w = static_cast<float>(luaL_checknumber(L, 3));
-            const auto h = static_cast<float>(luaL_checknumber(L, 4));
-            const bool uv = lua_isnone(L, 5) ? true : lua_toboolean(L, 5);
-            buffer = new Buffer(x, y, w, h, uv);
+            lua_pushinteger(L, bus);
         }
-        pushObject(L, buffer, "Buffer");
         return 1;
     }
 
-    int lua_newTexture(lua_State *L) {
-        Texture* texture;
-        if (lua_gettop(L) == 1) {
-            const char *name = luaL_checkstring(L, 1);
-            texture = new Texture(name);
+    int lua_audioBusGain(lua_State *L) {
+        lua_pushboolean(L, gAudio->busGain(static_cast<int>(luaL_checkinteger(L, 1)),
+                                           static_cast<float>(luaL_checknumber(L, 2))));
+        return 1;
+    }
 
-        }else {
-            std::vector<unsigned char> bitmap;
-            size_t size;
-            const char* p = luaL_checklstring(L, 1, &size);
-            bitmap.resize(size);
-            memcpy(bitmap.data(), p, size);
-            const int w = static_cast<int>(luaL_checkinteger(L, 2));
-            const int h = static_cast<int>(luaL_checkinteger(L, 3));
-            texture = new Texture(bitmap, w, h);
+    // audioBusEffect(bus, "lowpass"|"highpass", {cutoff=1000, q=0.707})
+    // audioBusEffect(bus, "delay", {time=0.3, feedback=0.4, mix=0.3})
+    // audioBusEffect(bus, "reverb", {room=0.5, damping=0.5, mix=0.25})
+    // 第三个参数为 false 或省略时关掉这个效果
+    int lua_audioBusEffect(lua_State *L) {
+        const auto bus = static_cast<int>(luaL_checkinteger(L, 1));
+        static const char *const types[] = {"highpass", "lowpass", "delay", "reverb", nullptr};
+        const auto type = static_cast<EffectType>(luaL_checkoption(L, 2, nullptr, types));
+        const bool enabled = lua_istable(L, 3);
+        float a = 0, b = 0, c = 0;
+        if (enabled && (type == EFFECT_HIGHPASS || type == EFFECT_LOWPASS)) {
+            a = static_cast<float>(readNumber(L, 3, "cutoff", 1000));
+            b = static_cast<float>(readNumber(L, 3, "q", 0.707));
+        } else if (enabled && type == EFFECT_DELAY) {
+            a = static_cast<float>(readNumber(L, 3, "time", 0.3));
+            b = static_cast<float>(readNumber(L, 3, "feedback", 0.4));
+            c = static_cast<float>(readNumber(L, 3, "mix", 0.3));
+        } else if (enabled) {
+            a = static_cast<float>(readNumber(L, 3, "room", 0.5));
+            b = static_cast<float>(readNumber(L, 3, "damping", 0.5));
+            c = static_cast<float>(readNumber(L, 3, "mix", 0.25));
         }
-        pushObject(L, texture, "Texture");
+        lua_pushboolean(L, gAudio->busEffect(bus, type, enabled, a, b, c));
         return 1;
     }
 
-    int lua_newFont(lua_State* L) {
-        const char* name = luaL_checkstring(L, 1);
-        auto* font = new Font(name);
-        pushObject(L, font, "Font");
+    // audioRoute(handle, bus) 把通道改混进 bus
+    int lua_audioRoute(lua_State *L) {
+        lua_pushboolean(L, gAudio->route(luaL_checkinteger(L, 1), static_cast<int>(luaL_checkinteger(L, 2))));
         return 1;
     }
 
-    int lua_audioOpen(lua_State* L) {
-        const char* name = luaL_checkstring(L, 1);
-        int loop = lua_isnone(L, 2) ? 1 : luaL_checkinteger(L, 2);
-        int idx = gAudio->open(name, loop);
-        lua_pushinteger(L, idx);
+    // audioBuses() -> { {bus=, parent=, effects={"lowpass", ...}, ms=, load=}, ... }，
+    // ms 和 load（占音频时长的比例）都是从上次调用到现在的
+    int lua_audioBuses(lua_State *L) {
+        static const char *const names[] = {"highpass", "lowpass", "delay", "reverb"};
+        const auto stats = gAudio->busStats();
+        lua_createtable(L, static_cast<int>(stats.size()), 0);
+        for (size_t i = 0; i < stats.size(); ++i) {
+            const Audio::BusStats &bus = stats[i];
+            lua_createtable(L, 0, 5);
+            lua_pushinteger(L, bus.bus);
+            lua_setfield(L, -2, "bus");
+            if (bus.parent >= 0) {
+                lua_pushinteger(L, bus.parent);
+                lua_setfield(L, -2, "parent");
+            }
+            lua_newtable(L);
+            int count = 0;
+            for (int e = 0; e < EFFECT_COUNT; ++e) {
+                if (bus.effects[e]) {
+                    lua_pushstring(L, names[e]);
+                    lua_rawseti(L, -2, ++count);
+                }
+            }
+            lua_setfield(L, -2, "effects");
+            lua_pushnumber(L, bus.ms);
+            lua_setfield(L, -2, "ms");
+            lua_pushnumber(L, bus.load);
+            lua_setfield(L, -2, "load");
+            lua_rawseti(L, -2, static_cast<int>(i + 1));
+        }
         return 1;
+    }
 
+    template<typename T>
+    void destroyObject(T *object) {
+        delete object;
     }
 
-    int lua_audioClose(lua_State* L) {
-            int idx = static_cast<int>(luaL_checkinteger(L, 1));
-        gAudio->close(idx);
-        return 0;
+    // 缓存里的纹理和字体只归还引用
+    void destroyObject(Texture *texture) {
+        if (!gResources->release(texture)) {
+            delete texture;
+        }
     }
 
-    int lua_audioPause(lua_State* L) {
-        int pause = static_cast<int>(luaL_checkinteger(L, 1));
-        gAudio->pause(pause);
-        return 0;
+    void destroyObject(Font *font) {
+        if (!gResources->release(font)) {
+            delete font;
+        }
     }
+
     template<typename T>
     int lua_object_gc(lua_State *L) {
         T **shader = static_cast<T **>(lua_touserdata(L, 1));
-        delete *shader;
+        destroyObject(*shader);
         return 0;
     }
 
+    // 第二个参数既可以是名字，也可以是 shader:uniform()/shader:attribute() 预先取得的整数句柄
     int lua_shader_attrib(lua_State *L) {
         auto **udata = static_cast<Shader **>(luaL_checkudata(L, 1, "Shader"));
-        const char *name = luaL_checkstring(L, 2);
+        const GLint location = lua_type(L, 2) == LUA_TNUMBER
+                                   ? static_cast<GLint>(lua_tointeger(L, 2))
+                                   : (*udata)->attribute(luaL_checkstring(L, 2));
         const auto size = static_cast<GLint>(luaL_checkinteger(L, 3));
         const auto type = static_cast<GLenum>(luaL_checkinteger(L, 4));
         const auto stride = static_cast<GLsizei>(luaL_optinteger(L, 5, 0));
         const void *pointer = lua_isnone(L, 6) ? nullptr : reinterpret_cast<void *>(lua_tointeger(L, 6));
-        (*udata)->attrib(name, size, type, stride, pointer);
+        gState.bindVertexArray(0); // 不要改写某个 Mesh 录好的 VAO
+        Shader::attrib(location, size, type, stride, pointer);
         return 0;
     }
 
     int lua_shader_setVec4(lua_State *L) {
         auto **udata = static_cast<Shader **>(luaL_checkudata(L, 1, "Shader"));
-        const char *name = luaL_checkstring(L, 2);
+        const GLint location = lua_type(L, 2) == LUA_TNUMBER
+                                   ? static_cast<GLint>(lua_tointeger(L, 2))
+                                   : (*udata)->uniform(luaL_checkstring(L, 2));
         const auto v0 = static_cast<float>(luaL_checknumber(L, 3));
         const auto v1 = static_cast<float>(luaL_checknumber(L, 4));
         const auto v2 = static_cast<float>(luaL_checknumber(L, 5));
         const auto v3 = static_cast<float>(luaL_checknumber(L, 6));
-        (*udata)->setVec4(name, v0, v1, v2, v3);
+        Shader::setVec4(location, v0, v1, v2, v3);
         return 0;
     }
 
     int lua_shader_setTexture(lua_State *L) {
         auto **udata = static_cast<Shader **>(luaL_checkudata(L, 1, "Shader"));
-        const char *name = luaL_checkstring(L, 2);
+        const GLint location = lua_type(L, 2) == LUA_TNUMBER
+                                   ? static_cast<GLint>(lua_tointeger(L, 2))
+                                   : (*udata)->uniform(luaL_checkstring(L, 2));
         const auto texture = static_cast<GLint>(luaL_checkinteger(L, 3));
-        (*udata)->setTexture(name, texture);
+        Shader::setTexture(location, texture);
         return 0;
     }
 
+    int lua_shader_uniform(lua_State *L) {
+        auto **udata = static_cast<Shader **>(luaL_checkudata(L, 1, "Shader"));
+        lua_pushinteger(L, (*udata)->uniform(luaL_checkstring(L, 2)));
+        return 1;
+    }
+
+    int lua_shader_attribute(lua_State *L) {
+        auto **udata = static_cast<Shader **>(luaL_checkudata(L, 1, "Shader"));
+        lua_pushinteger(L, (*udata)->attribute(luaL_checkstring(L, 2)));
+        return 1;
+    }
+
     int lua_shader_use(lua_State *L) {
         auto **udata = static_cast<Shader **>(luaL_checkudata(L, 1, "Shader"));
         (*udata)->use();
@@ -605,6 +5667,8 @@ namespace {
         {"setVec4", lua_shader_setVec4},
         {"setTexture", lua_shader_setTexture},
         {"use", lua_shader_use},
+        {"uniform", lua_shader_uniform},
+        {"attribute", lua_shader_attribute},
         // {0, 0},
         {nullptr, nullptr},
     };
@@ -664,11 +5728,451 @@ namespace {
         return 5;
     }
 
+    // font:drawText(str, x, y, size [, r, g, b, a]) -> width，需要调用方开启混合
+    int lua_font_drawText(lua_State *L) {
+        auto **udata = static_cast<Font **>(luaL_checkudata(L, 1, "Font"));
+        const char *text = luaL_checkstring(L, 2);
+        const auto x = static_cast<float>(luaL_checknumber(L, 3));
+        const auto y = static_cast<float>(luaL_checknumber(L, 4));
+        const auto size = static_cast<float>(luaL_checknumber(L, 5));
+        const auto r = static_cast<float>(luaL_optnumber(L, 6, 1.0));
+        const auto g = static_cast<float>(luaL_optnumber(L, 7, 1.0));
+        const auto b = static_cast<float>(luaL_optnumber(L, 8, 1.0));
+        const auto a = static_cast<float>(luaL_optnumber(L, 9, 1.0));
+        lua_pushnumber(L, (*udata)->drawText(text, x, y, size, r, g, b, a));
+        return 1;
+    }
+
+    void readColor(lua_State *L, const int index, const char *field, float color[4]) {
+        lua_getfield(L, index, field);
+        if (lua_istable(L, -1)) {
+            for (int i = 0; i < 4; ++i) {
+                lua_rawgeti(L, -1, i + 1);
+                if (!lua_isnil(L, -1)) {
+                    color[i] = static_cast<float>(lua_tonumber(L, -1));
+                }
+                lua_pop(L, 1);
+            }
+        }
+        lua_pop(L, 1);
+    }
+
+    // font:drawTextSDF(str, x, y, size [, r, g, b, a [, {outline=, outlineColor={}, glow=, glowColor={}}]])
+    // outline + glow 最多 size / 8 像素（SDF_PADDING / SDF_SIZE），超出的部分截掉，先保描边
+    int lua_font_drawTextSDF(lua_State *L) {
+        auto **udata = static_cast<Font **>(luaL_checkudata(L, 1, "Font"));
+        const char *text = luaL_checkstring(L, 2);
+        const auto x = static_cast<float>(luaL_checknumber(L, 3));
+        const auto y = static_cast<float>(luaL_checknumber(L, 4));
+        const auto size = static_cast<float>(luaL_checknumber(L, 5));
+        const auto r = static_cast<float>(luaL_optnumber(L, 6, 1.0));
+        const auto g = static_cast<float>(luaL_optnumber(L, 7, 1.0));
+        const auto b = static_cast<float>(luaL_optnumber(L, 8, 1.0));
+        const auto a = static_cast<float>(luaL_optnumber(L, 9, 1.0));
+        Font::SDFStyle style;
+        if (lua_istable(L, 10)) {
+            lua_getfield(L, 10, "outline");
+            style.outline = static_cast<float>(luaL_optnumber(L, -1, 0.0));
+            lua_getfield(L, 10, "glow");
+            style.glow = static_cast<float>(luaL_optnumber(L, -1, 0.0));
+            lua_pop(L, 2);
+            readColor(L, 10, "outlineColor", style.outlineColor);
+            readColor(L, 10, "glowColor", style.glowColor);
+        }
+        lua_pushnumber(L, (*udata)->drawText(text, x, y, size, r, g, b, a, &style));
+        return 1;
+    }
+
     const luaL_Reg font_meta[] = {
         {"__gc", lua_object_gc<Font>},
         {"makeBitmap", lua_font_makeBitmap},
+        {"drawText", lua_font_drawText},
+        {"drawTextSDF", lua_font_drawTextSDF},
+        {nullptr, nullptr},
+    };
+    int lua_spriteBatch_begin(lua_State *L) {
+        auto **udata = static_cast<SpriteBatch **>(luaL_checkudata(L, 1, "SpriteBatch"));
+        (*udata)->begin();
+        return 0;
+    }
+
+    int lua_spriteBatch_setShader(lua_State *L) {
+        auto **udata = static_cast<SpriteBatch **>(luaL_checkudata(L, 1, "SpriteBatch"));
+        const Shader *shader = nullptr;
+        if (!lua_isnoneornil(L, 2)) {
+            shader = *static_cast<Shader **>(luaL_checkudata(L, 2, "Shader"));
+        }
+        (*udata)->setShader(shader);
+        // 挂在 uservalue 上，防止 batch 还在用时 shader 被回收
+        lua_settop(L, 2);
+        lua_setiuservalue(L, 1, 1);
+        return 0;
+    }
+
+    // batch:draw(texture, x, y, w, h [, r, g, b, a])
+    int lua_spriteBatch_draw(lua_State *L) {
+        auto **udata = static_cast<SpriteBatch **>(luaL_checkudata(L, 1, "SpriteBatch"));
+        auto **texture = static_cast<Texture **>(luaL_checkudata(L, 2, "Texture"));
+        const auto x = static_cast<float>(luaL_checknumber(L, 3));
+        const auto y = static_cast<float>(luaL_checknumber(L, 4));
+        const auto w = static_cast<float>(luaL_checknumber(L, 5));
+        const auto h = static_cast<float>(luaL_checknumber(L, 6));
+        const auto r = static_cast<float>(luaL_optnumber(L, 7, 1.0));
+        const auto g = static_cast<float>(luaL_optnumber(L, 8, 1.0));
+        const auto b = static_cast<float>(luaL_optnumber(L, 9, 1.0));
+        const auto a = static_cast<float>(luaL_optnumber(L, 10, 1.0));
+        (*udata)->draw((*texture)->getID(), x, y, w, h, 0, 0, 1, 1, r, g, b, a);
+        return 0;
+    }
+
+    // batch:drawUV(texture, x, y, w, h, u0, v0, u1, v1 [, r, g, b, a])
+    int lua_spriteBatch_drawUV(lua_State *L) {
+        auto **udata = static_cast<SpriteBatch **>(luaL_checkudata(L, 1, "SpriteBatch"));
+        auto **texture = static_cast<Texture **>(luaL_checkudata(L, 2, "Texture"));
+        const auto x = static_cast<float>(luaL_checknumber(L, 3));
+        const auto y = static_cast<float>(luaL_checknumber(L, 4));
+        const auto w = static_cast<float>(luaL_checknumber(L, 5));
+        const auto h = static_cast<float>(luaL_checknumber(L, 6));
+        const auto u0 = static_cast<float>(luaL_checknumber(L, 7));
+        const auto v0 = static_cast<float>(luaL_checknumber(L, 8));
+        const auto u1 = static_cast<float>(luaL_checknumber(L, 9));
+        const auto v1 = static_cast<float>(luaL_checknumber(L, 10));
+        const auto r = static_cast<float>(luaL_optnumber(L, 11, 1.0));
+        const auto g = static_cast<float>(luaL_optnumber(L, 12, 1.0));
+        const auto b = static_cast<float>(luaL_optnumber(L, 13, 1.0));
+        const auto a = static_cast<float>(luaL_optnumber(L, 14, 1.0));
+        (*udata)->draw((*texture)->getID(), x, y, w, h, u0, v0, u1, v1, r, g, b, a);
+        return 0;
+    }
+
+    int lua_spriteBatch_flush(lua_State *L) {
+        auto **udata = static_cast<SpriteBatch **>(luaL_checkudata(L, 1, "SpriteBatch"));
+        (*udata)->flush();
+        return 0;
+    }
+
+    int lua_spriteBatch_stats(lua_State *L) {
+        auto **udata = static_cast<SpriteBatch **>(luaL_checkudata(L, 1, "SpriteBatch"));
+        lua_pushinteger(L, (*udata)->getDraws());
+        lua_pushinteger(L, (*udata)->getSprites());
+        return 2;
+    }
+
+    int lua_mesh_draw(lua_State *L) {
+        auto **udata = static_cast<Mesh **>(luaL_checkudata(L, 1, "Mesh"));
+        const auto mode = static_cast<GLenum>(luaL_checkinteger(L, 2));
+        const auto first = static_cast<GLint>(luaL_checkinteger(L, 3));
+        const auto count = static_cast<GLsizei>(luaL_checkinteger(L, 4));
+        (*udata)->draw(mode, first, count);
+        return 0;
+    }
+
+    const luaL_Reg mesh_meta[] = {
+        {"__gc", lua_object_gc<Mesh>},
+        {"draw", lua_mesh_draw},
+        {nullptr, nullptr},
+    };
+
+    int lua_instanceBuffer_clear(lua_State *L) {
+        auto **udata = static_cast<InstanceBuffer **>(luaL_checkudata(L, 1, "InstanceBuffer"));
+        (*udata)->clear();
+        return 0;
+    }
+
+    // instances:add(x, y, w, h [, ox, oy, angle [, r, g, b, a]])
+    int lua_instanceBuffer_add(lua_State *L) {
+        auto **udata = static_cast<InstanceBuffer **>(luaL_checkudata(L, 1, "InstanceBuffer"));
+        const auto x = static_cast<float>(luaL_checknumber(L, 2));
+        const auto y = static_cast<float>(luaL_checknumber(L, 3));
+        const auto w = static_cast<float>(luaL_checknumber(L, 4));
+        const auto h = static_cast<float>(luaL_checknumber(L, 5));
+        const auto ox = static_cast<float>(luaL_optnumber(L, 6, 0.0));
+        const auto oy = static_cast<float>(luaL_optnumber(L, 7, 0.0));
+        const auto angle = static_cast<float>(luaL_optnumber(L, 8, 0.0));
+        const auto r = static_cast<float>(luaL_optnumber(L, 9, 1.0));
+        const auto g = static_cast<float>(luaL_optnumber(L, 10, 1.0));
+        const auto b = static_cast<float>(luaL_optnumber(L, 11, 1.0));
+        const auto a = static_cast<float>(luaL_optnumber(L, 12, 1.0));
+        (*udata)->add(x, y, w, h, ox, oy, angle, r, g, b, a);
+        return 0;
+    }
+
+    int lua_instanceBuffer_count(lua_State *L) {
+        auto **udata = static_cast<InstanceBuffer **>(luaL_checkudata(L, 1, "InstanceBuffer"));
+        lua_pushinteger(L, (*udata)->count());
+        return 1;
+    }
+
+    const luaL_Reg instanceBuffer_meta[] = {
+        {"__gc", lua_object_gc<InstanceBuffer>},
+        {"clear", lua_instanceBuffer_clear},
+        {"add", lua_instanceBuffer_add},
+        {"count", lua_instanceBuffer_count},
+        {nullptr, nullptr},
+    };
+
+    // batch:drawRegion(atlas, handle, x, y [, w, h [, r, g, b, a]])，w/h 缺省为原图尺寸
+    int lua_spriteBatch_drawRegion(lua_State *L) {
+        auto **udata = static_cast<SpriteBatch **>(luaL_checkudata(L, 1, "SpriteBatch"));
+        auto **atlas = static_cast<Atlas **>(luaL_checkudata(L, 2, "Atlas"));
+        const auto handle = static_cast<int>(luaL_checkinteger(L, 3));
+        luaL_argcheck(L, (*atlas)->valid(handle), 3, "invalid atlas region");
+        const auto &region = (*atlas)->region(handle);
+        const auto x = static_cast<float>(luaL_checknumber(L, 4));
+        const auto y = static_cast<float>(luaL_checknumber(L, 5));
+        const auto w = static_cast<float>(luaL_optnumber(L, 6, region.w));
+        const auto h = static_cast<float>(luaL_optnumber(L, 7, region.h));
+        const auto r = static_cast<float>(luaL_optnumber(L, 8, 1.0));
+        const auto g = static_cast<float>(luaL_optnumber(L, 9, 1.0));
+        const auto b = static_cast<float>(luaL_optnumber(L, 10, 1.0));
+        const auto a = static_cast<float>(luaL_optnumber(L, 11, 1.0));
+        (*udata)->draw((*atlas)->page(region.page).getID(), x, y, w, h,
+                       region.u0, region.v0, region.u1, region.v1, r, g, b, a);
+        return 0;
+    }
+
+    const luaL_Reg spriteBatch_meta[] = {
+        {"__gc", lua_object_gc<SpriteBatch>},
+        {"begin", lua_spriteBatch_begin},
+        {"setShader", lua_spriteBatch_setShader},
+        {"draw", lua_spriteBatch_draw},
+        {"drawUV", lua_spriteBatch_drawUV},
+        {"drawRegion", lua_spriteBatch_drawRegion},
+        {"flush", lua_spriteBatch_flush},
+        {"stats", lua_spriteBatch_stats},
+        {nullptr, nullptr},
+    };
+
+    int lua_atlas_add(lua_State *L) {
+        auto **udata = static_cast<Atlas **>(luaL_checkudata(L, 1, "Atlas"));
+        const char *name = luaL_checkstring(L, 2);
+        const int handle = (*udata)->add(name);
+        if (handle < 0) {
+            lua_pushnil(L);
+        } else {
+            lua_pushinteger(L, handle);
+        }
+        return 1;
+    }
+
+    // atlas:region(handle) -> page, u0, v0, u1, v1, w, h
+    int lua_atlas_region(lua_State *L) {
+        auto **udata = static_cast<Atlas **>(luaL_checkudata(L, 1, "Atlas"));
+        const auto handle = static_cast<int>(luaL_checkinteger(L, 2));
+        luaL_argcheck(L, (*udata)->valid(handle), 2, "invalid atlas region");
+        const auto &region = (*udata)->region(handle);
+        lua_pushinteger(L, region.page);
+        lua_pushnumber(L, region.u0);
+        lua_pushnumber(L, region.v0);
+        lua_pushnumber(L, region.u1);
+        lua_pushnumber(L, region.v1);
+        lua_pushinteger(L, region.w);
+        lua_pushinteger(L, region.h);
+        return 7;
+    }
+
+    int lua_atlas_bind(lua_State *L) {
+        auto **udata = static_cast<Atlas **>(luaL_checkudata(L, 1, "Atlas"));
+        const auto page = static_cast<int>(luaL_checkinteger(L, 2));
+        const auto texture = static_cast<GLint>(luaL_optinteger(L, 3, 0));
+        luaL_argcheck(L, page >= 0 && page < (*udata)->pageCount(), 2, "invalid atlas page");
+        (*udata)->page(page).bind(texture);
+        return 0;
+    }
+
+    // atlas:stats() -> {占用率, ...}，每页一项
+    int lua_atlas_stats(lua_State *L) {
+        auto **udata = static_cast<Atlas **>(luaL_checkudata(L, 1, "Atlas"));
+        const int count = (*udata)->pageCount();
+        lua_createtable(L, count, 0);
+        for (int i = 0; i < count; ++i) {
+            lua_pushnumber(L, (*udata)->occupancy(i));
+            lua_rawseti(L, -2, i + 1);
+        }
+        return 1;
+    }
+
+    const luaL_Reg atlas_meta[] = {
+        {"__gc", lua_object_gc<Atlas>},
+        {"add", lua_atlas_add},
+        {"region", lua_atlas_region},
+        {"bind", lua_atlas_bind},
+        {"stats", lua_atlas_stats},
+        {nullptr, nullptr},
+    };
+
+    // 结果第一次取出时包装成 Texture/Font 对象并挂在 future 的 uservalue 上，之后都返回同一个
+    int pushFutureResult(lua_State *L, AssetFuture &future) {
+        if (lua_getiuservalue(L, 1, 1) != LUA_TNIL) {
+            return 1;
+        }
+        lua_pop(L, 1);
+        auto &job = *future.job;
+        if (job.state != Loader::READY) {
+            lua_pushnil(L);
+            return 1;
+        }
+        // 引用随对象转给 Lua，由 __gc 归还缓存
+        job.taken = true;
+        if (job.kind == Loader::TEXTURE) {
+            pushObject(L, job.texture, "Texture");
+        } else {
+            pushObject(L, job.font, "Font");
+        }
+        lua_pushvalue(L, -1);
+        lua_setiuservalue(L, 1, 1);
+        return 1;
+    }
+
+    // future:ready() -> 是否可取, 是否失败
+    int lua_future_ready(lua_State *L) {
+        auto **udata = static_cast<AssetFuture **>(luaL_checkudata(L, 1, "AssetFuture"));
+        const int state = (*udata)->job->state;
+        lua_pushboolean(L, state == Loader::READY);
+        lua_pushboolean(L, state == Loader::FAILED);
+        return 2;
+    }
+
+    // 未完成时返回 nil
+    int lua_future_get(lua_State *L) {
+        auto **udata = static_cast<AssetFuture **>(luaL_checkudata(L, 1, "AssetFuture"));
+        return pushFutureResult(L, **udata);
+    }
+
+    int lua_future_wait(lua_State *L) {
+        auto **udata = static_cast<AssetFuture **>(luaL_checkudata(L, 1, "AssetFuture"));
+        gLoader->wait((*udata)->job);
+        return pushFutureResult(L, **udata);
+    }
+
+    const luaL_Reg future_meta[] = {
+        {"__gc", lua_object_gc<AssetFuture>},
+        {"ready", lua_future_ready},
+        {"get", lua_future_get},
+        {"wait", lua_future_wait},
+        {nullptr, nullptr},
+    };
+
+    // newEmitter(name, x, y, [{loop=1, gain=1, near=32, far=640, curve="inverse"|"linear"|"quadratic", priority=0, bus=0}])
+    // 位置用世界坐标，听者由 audioListener 设置；对象被回收时停止
+    struct Emitter {
+        int id;
+    };
+
+    void destroyObject(Emitter *emitter) {
+        gAudioScene->remove(emitter->id);
+        delete emitter;
+    }
+
+    AudioScene::Params readEmitterParams(lua_State *L, const int index, AudioScene::Params params) {
+        if (!lua_istable(L, index)) {
+            return params;
+        }
+        params.loop = static_cast<int>(readNumber(L, index, "loop", params.loop));
+        params.gain = static_cast<float>(readNumber(L, index, "gain", params.gain));
+        params.near = static_cast<float>(readNumber(L, index, "near", params.near));
+        params.far = static_cast<float>(readNumber(L, index, "far", params.far));
+        params.priority = static_cast<int>(readNumber(L, index, "priority", params.priority));
+        params.bus = static_cast<int>(readNumber(L, index, "bus", params.bus));
+        static const char *const curves[] = {"linear", "inverse", "quadratic", nullptr};
+        lua_getfield(L, index, "curve");
+        if (!lua_isnil(L, -1)) {
+            params.curve = luaL_checkoption(L, -1, nullptr, curves);
+        }
+        lua_pop(L, 1);
+        return params;
+    }
+
+    int lua_newEmitter(lua_State *L) {
+        const char *name = luaL_checkstring(L, 1);
+        const auto x = static_cast<float>(luaL_checknumber(L, 2));
+        const auto y = static_cast<float>(luaL_checknumber(L, 3));
+        auto *emitter = new Emitter{gAudioScene->add(name, x, y, readEmitterParams(L, 4, {}))};
+        pushObject(L, emitter, "Emitter");
+        return 1;
+    }
+
+    Emitter &checkEmitter(lua_State *L) {
+        return **static_cast<Emitter **>(luaL_checkudata(L, 1, "Emitter"));
+    }
+
+    int lua_emitter_move(lua_State *L) {
+        const Emitter &emitter = checkEmitter(L);
+        gAudioScene->move(emitter.id, static_cast<float>(luaL_checknumber(L, 2)),
+                          static_cast<float>(luaL_checknumber(L, 3)));
+        return 0;
+    }
+
+    // 只改表里给出的字段，其余保持创建时的值
+    int lua_emitter_set(lua_State *L) {
+        const Emitter &emitter = checkEmitter(L);
+        luaL_checktype(L, 2, LUA_TTABLE);
+        gAudioScene->set(emitter.id, readEmitterParams(L, 2, gAudioScene->params(emitter.id)));
+        return 0;
+    }
+
+    int lua_emitter_stop(lua_State *L) {
+        gAudioScene->stop(checkEmitter(L).id);
+        return 0;
+    }
+
+    // emitter:playing() -> 是否还在播, 是否占着真实通道
+    int lua_emitter_playing(lua_State *L) {
+        const Emitter &emitter = checkEmitter(L);
+        lua_pushboolean(L, gAudioScene->playing(emitter.id));
+        lua_pushboolean(L, gAudioScene->real(emitter.id));
+        return 2;
+    }
+
+    // emitter:mix() -> 上一次 update 算出的增益, 声像
+    int lua_emitter_mix(lua_State *L) {
+        const Emitter &emitter = checkEmitter(L);
+        lua_pushnumber(L, gAudioScene->gain(emitter.id));
+        lua_pushnumber(L, gAudioScene->pan(emitter.id));
+        return 2;
+    }
+
+    const luaL_Reg emitter_meta[] = {
+        {"__gc", lua_object_gc<Emitter>},
+        {"move", lua_emitter_move},
+        {"set", lua_emitter_set},
+        {"stop", lua_emitter_stop},
+        {"playing", lua_emitter_playing},
+        {"mix", lua_emitter_mix},
         {nullptr, nullptr},
     };
+
+    // audioListener(x, y, [panWidth=320])，panWidth 是横向差多少算完全偏到一边
+    int lua_audioListener(lua_State *L) {
+        gAudioScene->setListener(static_cast<float>(luaL_checknumber(L, 1)),
+                                 static_cast<float>(luaL_checknumber(L, 2)),
+                                 static_cast<float>(luaL_optnumber(L, 3, 320)));
+        return 0;
+    }
+
+    // audioEmitterBudget(n) 最多同时占用几个真实通道，默认 32
+    int lua_audioEmitterBudget(lua_State *L) {
+        gAudioScene->setBudget(static_cast<int>(luaL_checkinteger(L, 1)));
+        return 0;
+    }
+
+    // audioEmitterStats() -> {emitters=, real=, virtual=, dropped=, ms=}
+    int lua_audioEmitterStats(lua_State *L) {
+        const AudioScene::Stats stats = gAudioScene->stats();
+        lua_createtable(L, 0, 5);
+        lua_pushinteger(L, stats.emitters);
+        lua_setfield(L, -2, "emitters");
+        lua_pushinteger(L, stats.real);
+        lua_setfield(L, -2, "real");
+        lua_pushinteger(L, stats.virtualized);
+        lua_setfield(L, -2, "virtual");
+        lua_pushinteger(L, stats.dropped);
+        lua_setfield(L, -2, "dropped");
+        lua_pushnumber(L, stats.ms);
+        lua_setfield(L, -2, "ms");
+        return 1;
+    }
+
     void makeObject(lua_State *L, const char *name, const luaL_Reg *meta) {
         luaL_newmetatable(L, name);
         luaL_setfuncs(L, meta, 0);
@@ -714,6 +6218,10 @@ namespace {
             lua_setglobal(L, "newBuffer");
             makeObject(L, "Buffer", buffer_meta);
 
+            lua_pushcfunction(L, lua_newMesh);
+            lua_setglobal(L, "newMesh");
+            makeObject(L, "Mesh", mesh_meta);
+
             lua_pushcfunction(L, lua_newTexture);
             lua_setglobal(L, "newTexture");
             makeObject(L, "Texture", texture_meta);
@@ -728,13 +6236,89 @@ namespace {
             lua_pushcfunction(L, lua_font_makeBitmap);
             lua_setglobal(L, "font_makeBitmap");
 
+            lua_pushcfunction(L, lua_newAtlas);
+            lua_setglobal(L, "newAtlas");
+            makeObject(L, "Atlas", atlas_meta);
+
+            lua_pushcfunction(L, lua_newSpriteBatch);
+            lua_setglobal(L, "newSpriteBatch");
+            makeObject(L, "SpriteBatch", spriteBatch_meta);
+            lua_pushcfunction(L, lua_newInstanceBuffer);
+            lua_setglobal(L, "newInstanceBuffer");
+            makeObject(L, "InstanceBuffer", instanceBuffer_meta);
+            lua_pushcfunction(L, lua_drawRectsInstanced);
+            lua_setglobal(L, "drawRectsInstanced");
+            lua_pushcfunction(L, lua_getFrameStats);
+            lua_setglobal(L, "getFrameStats");
+
+            lua_pushcfunction(L, lua_zipExists);
+            lua_setglobal(L, "zipExists");
+            lua_pushcfunction(L, lua_zipStat);
+            lua_setglobal(L, "zipStat");
+            lua_pushcfunction(L, lua_zipList);
+            lua_setglobal(L, "zipList");
+
+            lua_pushcfunction(L, lua_loadTextureAsync);
+            lua_setglobal(L, "loadTextureAsync");
+            lua_pushcfunction(L, lua_loadFontAsync);
+            lua_setglobal(L, "loadFontAsync");
+            lua_pushcfunction(L, lua_setLoadBudget);
+            lua_setglobal(L, "setLoadBudget");
+            makeObject(L, "AssetFuture", future_meta);
+            lua_pushcfunction(L, lua_resourceStats);
+            lua_setglobal(L, "resourceStats");
+            lua_pushcfunction(L, lua_setResourceBudget);
+            lua_setglobal(L, "setResourceBudget");
+
             lua_pushcfunction(L, lua_audioOpen);
             lua_setglobal(L, "audioOpen");
             lua_pushcfunction(L, lua_audioClose);
             lua_setglobal(L, "audioClose");
             lua_pushcfunction(L, lua_audioPause);
             lua_setglobal(L, "audioPause");
-
+            lua_pushcfunction(L, lua_audioVolume);
+            lua_setglobal(L, "audioVolume");
+            lua_pushcfunction(L, lua_audioSet);
+            lua_setglobal(L, "audioSet");
+            lua_pushcfunction(L, lua_audioScheduleAt);
+            lua_setglobal(L, "audioScheduleAt");
+            lua_pushcfunction(L, lua_audioStopAt);
+            lua_setglobal(L, "audioStopAt");
+            lua_pushcfunction(L, lua_audioSetAt);
+            lua_setglobal(L, "audioSetAt");
+            lua_pushcfunction(L, lua_audioTime);
+            lua_setglobal(L, "audioTime");
+            lua_pushcfunction(L, lua_audioSeek);
+            lua_setglobal(L, "audioSeek");
+            lua_pushcfunction(L, lua_audioEvents);
+            lua_setglobal(L, "audioEvents");
+            lua_pushcfunction(L, lua_audioSetStealPolicy);
+            lua_setglobal(L, "audioSetStealPolicy");
+            lua_pushcfunction(L, lua_audioVoices);
+            lua_setglobal(L, "audioVoices");
+            lua_pushcfunction(L, lua_audioSetSampleLength);
+            lua_setglobal(L, "audioSetSampleLength");
+            lua_pushcfunction(L, lua_audioSamples);
+            lua_setglobal(L, "audioSamples");
+            makeObject(L, "Emitter", emitter_meta);
+            lua_pushcfunction(L, lua_newEmitter);
+            lua_setglobal(L, "newEmitter");
+            lua_pushcfunction(L, lua_audioListener);
+            lua_setglobal(L, "audioListener");
+            lua_pushcfunction(L, lua_audioEmitterBudget);
+            lua_setglobal(L, "audioEmitterBudget");
+            lua_pushcfunction(L, lua_audioEmitterStats);
+            lua_setglobal(L, "audioEmitterStats");
+            lua_pushcfunction(L, lua_audioBus);
+            lua_setglobal(L, "audioBus");
+            lua_pushcfunction(L, lua_audioBusGain);
+            lua_setglobal(L, "audioBusGain");
+            lua_pushcfunction(L, lua_audioBusEffect);
+            lua_setglobal(L, "audioBusEffect");
+            lua_pushcfunction(L, lua_audioRoute);
+            lua_setglobal(L, "audioRoute");
+            lua_pushcfunction(L, lua_audioBuses);
+            lua_setglobal(L, "audioBuses");
         }
 
     public:
@@ -746,10 +6330,12 @@ namespace {
 
             lua_pushcfunction(L, lua_ziploader);
             lua_setglobal(L, "ziploader");
+            lua_pushcfunction(L, lua_zipsearcher);
+            lua_setglobal(L, "zipsearcher");
             lua_pushcfunction(L, lua_error_callback);
             int ret = luaL_loadstring(
                 L,
-                "table.insert(package.searchers, function() return ziploader end)\n"
+                "table.insert(package.searchers, zipsearcher)\n"
                 // "require 'data.main'");
                 "require 'main'");
             if (ret == 0) {
@@ -803,6 +6389,7 @@ namespace {
 
 }
 
+#ifndef MINI2D_NO_MAIN
 int main(int argc, char **argv) {
     printf("mini2d\n");
     SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
@@ -814,10 +6401,19 @@ int main(int argc, char **argv) {
         printf("Failed to initialize GLAD\n");
         return -1;
     }
+    if (!loadGL3()) {
+        printf("Failed to load GL 3.3 entry points\n");
+        return -1;
+    }
 
     printf("GL_VERSION:%s\n", reinterpret_cast<const char *>(glGetString(GL_VERSION)));
 
     gZip = new Zip("../data/data.zip");
+    gPack = new Pack("../data/data.pack");
+    if (!gPack->valid()) {
+        delete gPack;
+        gPack = nullptr;
+    }
 
     auto _checkGLError = [](const char *file, const int line) {
         for (GLint error = glGetError(); error != GL_NO_ERROR; error = glGetError()) {
@@ -961,10 +6557,18 @@ int main(int argc, char **argv) {
     // audio.open("data/SadSoul.ogg");
     // audio.pause(0);
 
-    gAudio = new Audio();
+    gResources = new ResourceCache();
+    gAudio = new Audio(256);
+    gAudioScene = new AudioScene(*gAudio);
+    gSpriteShader = new Shader(spriteVsSrc, spriteFsSrc);
+    gRectShader = new Shader(rectVsSrc, rectFsSrc);
+    gGlyphCache = new GlyphCache();
+    gTextBatch = new SpriteBatch(1024);
+    gSDFShader = new Shader(spriteVsSrc, sdfFsSrc);
+    gLoader = new Loader();
 
 
-    Lua lua;
+    auto *lua = new Lua();
 
     int done = 0;
     while (!done) {
@@ -974,27 +6578,43 @@ int main(int argc, char **argv) {
                 done = 1;
             }
             else if (event.type == SDL_MOUSEBUTTONDOWN) {
-                lua.mouseEvent(event.type, event.button.x, event.button.y, event.button.button);
+                lua->mouseEvent(event.type, event.button.x, event.button.y, event.button.button);
             } else if (event.type == SDL_MOUSEBUTTONUP) {
-                lua.mouseEvent(event.type, event.button.x, event.button.y, event.button.button);
+                lua->mouseEvent(event.type, event.button.x, event.button.y, event.button.button);
             } else if (event.type == SDL_MOUSEMOTION) {
-                lua.mouseEvent(event.type, event.motion.x, event.motion.y, 0);
+                lua->mouseEvent(event.type, event.motion.x, event.motion.y, 0);
             } else if (event.type == SDL_KEYDOWN) {
-                lua.keyEvent(event.type, event.key.keysym.sym);
+                lua->keyEvent(event.type, event.key.keysym.sym);
             } else if (event.type == SDL_KEYUP) {
-                lua.keyEvent(event.type, event.key.keysym.sym);
+                lua->keyEvent(event.type, event.key.keysym.sym);
             }
         }
-        lua.draw();
-        lua.clearEvents();
+        gLoader->pump();
+        lua->draw();
+        gAudioScene->update(); // Lua 这一帧移动过的发声体一起算
+        lua->clearEvents();
+        gLastFrameStats = gFrameStats;
+        gFrameStats = FrameStats();
         // audio.play();
 
-        gAudio->play();
         checkGLError();
         SDL_GL_SwapWindow(window);
     };
-    SDL_DestroyWindow(window);
+    delete lua; // 先回收 Lua 对象，它们会把引用还给缓存
+    delete gAudioScene;
     delete gAudio;
+    delete gLoader;
+    delete gResources;
+    gResources = nullptr;
+    delete gSDFShader;
+    delete gTextBatch;
+    delete gGlyphCache;
+    gGlyphCache = nullptr;
+    delete gRectShader;
+    delete gSpriteShader;
+    SDL_DestroyWindow(window);
+    delete gPack;
     delete gZip;
     return 0;
 }
+#endif
@@ -12,6 +12,20 @@ local GL_ONE_MINUS_SRC_ALPHA<const> = 0x0303
 audioOpen("data/MeetingTheStars.ogg", 0);
 audioOpen("data/SadSoul.ogg");
 -- audioPause(0);
+-- audioOpen 返回句柄：audioPause(h, 1)、audioVolume(h, 0.5)、audioSeek(h, 30)、audioClose(h)
+-- 音量、声像、音调一起改：audioSet(h, {gain = 0.8, pan = -0.5, pitch = 1.2})
+-- 通道用完时：audioSetStealPolicy("lowest")，audioOpen(name, 0, 2) 可以抢优先级 <= 2 的通道；audioVoices() 看占用
+-- 每帧取播完的通道：for _, e in ipairs(audioEvents()) do print(e.voice, e.event) end
+-- 短音效（默认不超过 2 秒）第一次播放后常驻内存：audioSetSampleLength(1.5, 32)（常驻最多 32 MB）、audioSamples().hits
+-- 各内核的耗时和一致性、命令环压力、离线渲染见构建目录下的 mini2d_tests
+-- 精确到帧的定时：local now, rate = audioTime(); local h = audioScheduleAt("data/hit.ogg", now + rate // 2)
+-- audioSetAt(h, now + rate, {gain = 0.5})、audioStopAt(h, now + rate * 2)
+-- 世界坐标里的发声体：local e = newEmitter("data/fire.ogg", 400, 300, {near = 32, far = 640, curve = "inverse"})
+-- 每帧 e:move(x, y)、audioListener(camX, camY)；听不见或超出 audioEmitterBudget(32) 的循环音自动虚拟化（至少 0.25 秒才恢复），
+-- audioEmitterStats() 看 real/virtual/dropped
+-- 效果总线：local sfx = audioBus(); audioBusEffect(sfx, "lowpass", {cutoff = 800}); audioBusEffect(sfx, "reverb", {room = 0.7, mix = 0.3})
+-- audioRoute(h, sfx) 或 newEmitter(..., {bus = sfx})；audioBusEffect(sfx, "reverb") 关掉混响
+-- 每条总线的耗时：for _, b in ipairs(audioBuses()) do print(b.bus, b.ms, b.load) end
 local vsSrc<const> =
 [[
     #version 330 core
@@ -51,6 +65,8 @@ local fsSrc<const> =
 local shader = newShader(vsSrc, fsSrc)
 
 local texture = newTexture("data/uvchecker.png");
+-- 后台解码，主循环按帧预算上传：local pending = loadTextureAsync("data/uvchecker.png")
+-- 之后每帧 if pending:ready() then texture = pending:get() end，或直接 pending:wait()
 
 local vsSrcUV = [[
     #version 330 core
@@ -102,6 +118,15 @@ local fsSrcFont = [[
 
 local shaderfont = newShader(vsSrcUV, fsSrcFont);
 
+local batch = newSpriteBatch(4096)
+local rects = newInstanceBuffer(256)
+
+-- 属性布局在创建时录进 VAO，draw 时不再重复 bind + attrib
+local meshRect = newMesh(bufferRect, shader, {{"position", 2, GL_FLOAT}})
+local layoutUV = {{"position", 2, GL_FLOAT, 4 * 4, 0}, {"texcoord", 2, GL_FLOAT, 4 * 4, 2 * 4}}
+local meshUV = newMesh(buffer, shaderUV, layoutUV)
+local meshFont = newMesh(bufferFont, shaderfont, layoutUV)
+
 local function drawPoint(buffer, shader)
         buffer:bind();
         shader:attrib("position", 2, GL_FLOAT);
@@ -118,28 +143,37 @@ local function drawLine(buffer, shader)
         glDrawArrays(GL_LINES, 0, 2);
         buffer:unbind();
 end
-local function drawRect(buffer, shader, x, y, w, h, ox, oy, angle)
-        buffer:bind();
-        shader:attrib("position", 2, GL_FLOAT);
+-- uniform/attribute 句柄只在第一次用到某个 shader 时解析
+local slots = setmetatable({}, {__mode = "k"})
+local function slotsOf(shader)
+        local s = slots[shader]
+        if not s then
+                s = {
+                        color = shader:uniform("color"),
+                        pos_size = shader:uniform("pos_size"),
+                        rotation = shader:uniform("rotation"),
+                }
+                slots[shader] = s
+        end
+        return s
+end
+
+local function drawRect(mesh, shader, x, y, w, h, ox, oy, angle)
+        local s = slotsOf(shader)
         shader:use();
-        shader:setVec4("color", 0.0, 0.0, 1.0, 1.0);
-        shader:setVec4("pos_size", x, y, w, h)
-        shader:setVec4("rotation", ox or 0.0, oy or 0.0, angle or 0.0, 0.0);
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-        buffer:unbind();
+        shader:setVec4(s.color, 0.0, 0.0, 1.0, 1.0);
+        shader:setVec4(s.pos_size, x, y, w, h)
+        shader:setVec4(s.rotation, ox or 0.0, oy or 0.0, angle or 0.0, 0.0);
+        mesh:draw(GL_TRIANGLE_STRIP, 0, 4);
 end
 
-local function drawRectUV(buffer, shader, texture)
-        buffer:bind();
-        shader:attrib("position", 2, GL_FLOAT, 4 * 4, nullptr);
-        shader:attrib("texcoord", 2, GL_FLOAT, 4 * 4, 2 * 4);
+local function drawRectUV(mesh, shader, texture)
         shader:use();
         shader:setVec4("color", 1.0, 1.0, 1.0, 1.0);
         shader:setTexture("texture0", 0);
         texture:bind(0);
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        mesh:draw(GL_TRIANGLE_STRIP, 0, 4);
         texture:unbind();
-        buffer:unbind();
 end
 
 function draw()
@@ -149,20 +183,38 @@ function draw()
         glViewport(0, 0, winW, winH);
 --         drawPoint(bufferPoint, shader)
 --         drawLine(bufferLine, shader)
-        drawRect(bufferRect, shader, 0, 0, 350, 350, 0, 0, 45)
+        drawRect(meshRect, shader, 0, 0, 350, 350, 0, 0, 45)
 
 --         绘制正弦波
 --         for x = 0, 2 * math.pi, 0.1 do
 --             local y = (math.sin(x) * 0.5 + 0.5) * winH * 0.5 + 0.25 * winH
---             drawRect(bufferRect, shader, (winW - 1) * x / (2 * math.pi), y, 5, 5)
+--             drawRect(meshRect, shader, (winW - 1) * x / (2 * math.pi), y, 5, 5)
 --         end
---         drawRectUV(buffer, shaderUV, texture)
+--         同样的正弦波，所有矩形一次实例化绘制
+--         rects:clear()
+--         for x = 0, 2 * math.pi, 0.1 do
+--             local y = (math.sin(x) * 0.5 + 0.5) * winH * 0.5 + 0.25 * winH
+--             rects:add((winW - 1) * x / (2 * math.pi), y, 5, 5, 0, 0, 0, 0.0, 0.0, 1.0, 1.0)
+--         end
+--         drawRectsInstanced(rects)
+--         drawRectUV(meshUV, shaderUV, texture)
 --
 --         glEnable(GL_BLEND);
 --         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
---         drawRectUV(bufferFont, shaderfont, textureFont);
+--         drawRectUV(meshFont, shaderfont, textureFont);
+--         font:drawText("你好，mini2d", 20, 20, 32, 1.0, 1.0, 0.0, 1.0);
+--         font:drawTextSDF("缩放不失真", 20, 80, 24 + 16 * math.sin(os.clock()), 1.0, 1.0, 1.0, 1.0,
+--                          {outline = 1, outlineColor = {0, 0, 0, 1}, glow = 2, glowColor = {1, 0.5, 0, 0.6}}); -- 两者合计最多 size / 8
 --         glDisable(GL_BLEND);
 
+--         批量绘制：同一纹理的精灵合并成一次 draw call
+--         batch:begin()
+--         for i = 0, 999 do
+--             batch:draw(texture, (i % 40) * 16, (i // 40) * 16, 14, 14)
+--         end
+--         batch:flush()
+--         print(getFrameStats().drawCalls, batch:stats())
+
 --         if MouseEvent ~= 0 then print(MouseEvent, MouseX, MouseY, MouseButton) end -- ~=为不等于
 --         if KeyEvent ~= 0 then print(KeyEvent, KeyCode) end
 end
\ No newline at end of file
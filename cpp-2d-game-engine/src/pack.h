@@ -0,0 +1,75 @@
+#pragma once
+
+// mini2d_cook 生成、引擎映射读取的资源包格式：
+// Header | 数据块（按 ALIGN 对齐）... | Entry[count]
+// 所有整数按小端存放，映射后直接按结构体读取
+#include <cstddef>
+#include <cstdint>
+
+namespace pack {
+    constexpr char MAGIC[4] = {'M', '2', 'D', 'P'};
+    constexpr uint32_t VERSION = 1;
+    constexpr uint64_t ALIGN = 16;
+    constexpr size_t NAME_SIZE = 104;
+
+    enum Kind : uint32_t {
+        RAW = 0,     // 原样保存的文件（音频、字体等）
+        TEXTURE = 1, // RGBA8，levels 层 mip 从大到小紧排
+        GLYPHS = 2,  // 距离场字形图集：Glyph[levels]，后面跟 width * height 的单通道页
+        LUA = 3,     // lua_dump 出的去掉调试信息的字节码
+    };
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t count; // 目录项数
+        uint32_t reserved;
+        uint64_t tocOffset;
+    };
+
+    struct Entry {
+        char name[NAME_SIZE]; // 归一化路径，\0 结尾；字形图集为 "<字体路径>#sdf"
+        uint32_t kind;
+        uint32_t width;
+        uint32_t height;
+        uint32_t levels; // TEXTURE 为 mip 层数，GLYPHS 为字形数
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    struct Glyph {
+        int32_t code;
+        int16_t x0, y0; // 相对笔位置/基线的偏移
+        uint16_t x, y; // 在图集页里的位置
+        uint16_t w, h;
+    };
+
+    static_assert(sizeof(Header) == 24, "pack header layout");
+    static_assert(sizeof(Entry) == 136, "pack entry layout");
+    static_assert(sizeof(Glyph) == 16, "pack glyph layout");
+
+    // 烘焙距离场用的参数，引擎的 GlyphCache 也用这一组，改动时要提升 VERSION
+    constexpr int SDF_SIZE = 48;
+    constexpr int SDF_PADDING = 6;
+    constexpr unsigned char SDF_ONEDGE = 128;
+    constexpr int GLYPH_FIRST = 32; // 预烘焙的码点范围：可打印 ASCII
+    constexpr int GLYPH_LAST = 126;
+
+    inline uint64_t alignUp(const uint64_t n) {
+        return (n + ALIGN - 1) & ~(ALIGN - 1);
+    }
+
+    inline uint32_t levelSize(const uint32_t n, const uint32_t level) {
+        const uint32_t size = n >> level;
+        return size > 0 ? size : 1;
+    }
+
+    // levels 层 mip 加起来的字节数
+    inline uint64_t textureBytes(const uint32_t w, const uint32_t h, const uint32_t levels) {
+        uint64_t bytes = 0;
+        for (uint32_t i = 0; i < levels; ++i) {
+            bytes += static_cast<uint64_t>(levelSize(w, i)) * levelSize(h, i) * 4;
+        }
+        return bytes;
+    }
+}
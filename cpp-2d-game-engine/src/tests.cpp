@@ -0,0 +1,633 @@
+// mini2d_tests：音频内核、命令环和离线渲染的自检，顺带打印各内核的耗时。
+// 直接包含引擎源码，这样能测到匿名命名空间里的东西；任何一项不通过都返回非 0
+#define MINI2D_NO_MAIN
+#include "main.cpp"
+
+namespace {
+    // 原来 Audio::play 的写法：逐个采样遍历所有通道、检查标志、分支钳位，只留给基准测试对比
+    void mixLegacy(short *out, const std::vector<short> *samples, const bool *active, const int voices,
+                   const size_t n) {
+        for (size_t k = 0; k < n; ++k) {
+            int sample = 0;
+            for (int i = 0; i < voices; ++i) {
+                if (!active[i]) {
+                    continue;
+                }
+                sample += samples[i][k];
+            }
+            constexpr int s16max = static_cast<short>(0x7FFF);
+            constexpr int s16min = static_cast<short>(0x8000);
+            if (sample > s16max) {
+                sample = s16max;
+            }
+            if (sample < s16min) {
+                sample = s16min;
+            }
+            out[k] = static_cast<short>(sample);
+        }
+    }
+
+    struct MixBenchmark {
+        int voices;
+        double legacyNs; // 每个输出采样的耗时
+        std::vector<std::pair<const char *, double> > kernelNs;
+        bool match; // 各内核输出和标量版本逐位一致
+    };
+
+    // 一个设备块（1024 帧双声道）的混音，重复到每项至少跑 blocks 次；内核的耗时包括转 float
+    MixBenchmark benchmarkMix(const int voices, const int blocks) {
+        constexpr size_t N = 2048;
+        std::vector<std::vector<short> > samples(voices, std::vector<short>(N));
+        std::unique_ptr<bool[]> active(new bool[voices]);
+        unsigned int seed = 12345;
+        for (int i = 0; i < voices; ++i) {
+            active[i] = true;
+            for (auto &v: samples[i]) {
+                seed = seed * 1664525u + 1013904223u;
+                v = static_cast<short>(seed >> 16);
+            }
+        }
+        std::vector<float> acc(N);
+        std::vector<float> src(N);
+        std::vector<short> out(N);
+        std::vector<short> reference(N);
+        const double toNs = 1e9 / static_cast<double>(SDL_GetPerformanceFrequency());
+        const double samplesMixed = static_cast<double>(N) * blocks;
+        const MixGain unity{1.0f, 1.0f, 0.0f, 0.0f};
+
+        MixBenchmark result{voices, 0, {}, true};
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int b = 0; b < blocks; ++b) {
+            mixLegacy(out.data(), samples.data(), active.get(), voices, N);
+        }
+        result.legacyNs = static_cast<double>(SDL_GetPerformanceCounter() - start) * toNs / samplesMixed;
+
+        const auto kernels = availableMixKernels();
+        for (auto it = kernels.rbegin(); it != kernels.rend(); ++it) { // 标量先跑，作为对照
+            start = SDL_GetPerformanceCounter();
+            for (int b = 0; b < blocks; ++b) {
+                std::fill(acc.begin(), acc.end(), 0.0f);
+                for (int i = 0; i < voices; ++i) {
+                    toFloat(src.data(), samples[i].data(), N);
+                    it->accumulate(acc.data(), src.data(), unity, N / 2);
+                }
+                it->saturate(out.data(), acc.data(), N);
+            }
+            result.kernelNs.emplace_back(it->name,
+                                         static_cast<double>(SDL_GetPerformanceCounter() - start) * toNs /
+                                         samplesMixed);
+            if (it == kernels.rbegin()) {
+                reference = out;
+            } else if (out != reference) {
+                result.match = false;
+            }
+        }
+        return result;
+    }
+
+    struct ResampleBenchmark {
+        const char *name;
+        double step; // 每个输出帧前进的输入帧数 = 音调 * 源采样率 / 设备采样率
+        std::vector<std::pair<const char *, double> > kernelNs; // 每个通道每输出一帧的耗时
+        bool match;
+    };
+
+    // 单个通道按常见的采样率比例和变调重采样一个设备块，带增益渐变
+    std::vector<ResampleBenchmark> benchmarkResample(const int blocks) {
+        constexpr size_t FRAMES = 1024;
+        static const std::pair<const char *, double> cases[] = {
+            {"44100->44100", 1.0},
+            {"48000->44100", 48000.0 / 44100.0},
+            {"22050->48000", 22050.0 / 48000.0},
+            {"pitch 1.5", 1.5},
+        };
+        const size_t inputFrames = static_cast<size_t>(FRAMES * 1.5) + 4;
+        std::vector<float> src(inputFrames * 2);
+        unsigned int seed = 12345;
+        for (auto &v: src) {
+            seed = seed * 1664525u + 1013904223u;
+            v = static_cast<float>(static_cast<short>(seed >> 16));
+        }
+        std::vector<float> acc(FRAMES * 2);
+        std::vector<float> reference(FRAMES * 2);
+        const double toNs = 1e9 / static_cast<double>(SDL_GetPerformanceFrequency());
+        const MixGain gain{0.8f, 0.6f, -0.0001f, 0.0002f};
+        const auto kernels = availableMixKernels();
+
+        std::vector<ResampleBenchmark> results;
+        for (const auto &c: cases) {
+            ResampleBenchmark result{c.first, c.second, {}, true};
+            for (auto it = kernels.rbegin(); it != kernels.rend(); ++it) {
+                const Uint64 start = SDL_GetPerformanceCounter();
+                for (int b = 0; b < blocks; ++b) {
+                    std::fill(acc.begin(), acc.end(), 0.0f);
+                    if (c.second == 1.0) {
+                        it->accumulate(acc.data(), src.data() + 2, gain, FRAMES);
+                    } else {
+                        it->resample(acc.data(), src.data(), 0.25, c.second, gain, FRAMES);
+                    }
+                }
+                result.kernelNs.emplace_back(it->name, static_cast<double>(SDL_GetPerformanceCounter() - start) *
+                                                       toNs / (static_cast<double>(FRAMES) * blocks));
+                if (it == kernels.rbegin()) {
+                    reference = acc;
+                } else if (acc != reference) {
+                    result.match = false;
+                }
+            }
+            results.push_back(std::move(result));
+        }
+        return results;
+    }
+
+
+    struct EffectBenchmark {
+        const char *name;
+        std::vector<std::pair<const char *, double> > kernelNs; // 每输出一帧的耗时
+        bool match;
+    };
+
+    // 每种效果处理同一段噪声，各内核从相同的初始状态开始，结果应当逐位一致
+    std::vector<EffectBenchmark> benchmarkEffects(const int blocks, const int rate) {
+        constexpr size_t FRAMES = 1024;
+        std::vector<float> input(FRAMES * 2);
+        unsigned int seed = 12345;
+        for (auto &v: input) {
+            seed = seed * 1664525u + 1013904223u;
+            v = static_cast<float>(static_cast<short>(seed >> 16));
+        }
+        Biquad biquad;
+        biquad.design(EFFECT_LOWPASS, 1200.0, 0.707, rate);
+        DelayLine delay;
+        delay.line.assign(static_cast<size_t>(rate) * 2, 0.0f);
+        delay.length = static_cast<size_t>(rate) * 3 / 10;
+        Reverb reverb;
+        reverb.allocate(rate);
+
+        const double toNs = 1e9 / static_cast<double>(SDL_GetPerformanceFrequency());
+        const auto kernels = availableEffectKernels();
+        std::vector<EffectBenchmark> results;
+        static const std::pair<const char *, EffectType> cases[] = {
+            {"biquad", EFFECT_LOWPASS}, // 高通只是系数不同
+            {"delay", EFFECT_DELAY},
+            {"reverb", EFFECT_REVERB},
+        };
+        for (const auto &c: cases) {
+            const EffectType type = c.second;
+            EffectBenchmark result{c.first, {}, true};
+            std::vector<float> reference;
+            for (auto it = kernels.rbegin(); it != kernels.rend(); ++it) {
+                Biquad f = biquad;
+                DelayLine d = delay;
+                Reverb r = reverb;
+                std::vector<float> buf = input;
+                const Uint64 start = SDL_GetPerformanceCounter();
+                for (int b = 0; b < blocks; ++b) {
+                    std::copy(input.begin(), input.end(), buf.begin());
+                    if (type == EFFECT_LOWPASS) {
+                        runBiquad(*it, f, buf.data(), FRAMES);
+                    } else if (type == EFFECT_DELAY) {
+                        runDelay(*it, d, buf.data(), FRAMES);
+                    } else {
+                        runReverb(*it, r, buf.data(), FRAMES);
+                    }
+                }
+                result.kernelNs.emplace_back(it->name, static_cast<double>(SDL_GetPerformanceCounter() - start) *
+                                                       toNs / (static_cast<double>(FRAMES) * std::max(blocks, 1)));
+                if (it == kernels.rbegin()) {
+                    reference = buf;
+                } else if (buf != reference) {
+                    result.match = false;
+                }
+            }
+            results.push_back(std::move(result));
+        }
+        return results;
+    }
+
+
+    // 离线渲染时间线上的一条：在 time 秒对 id 号声音执行 op，id 由调用方自己编号
+    struct AudioCue {
+        enum Op { OPEN, CLOSE, PAUSE, VOLUME, PAN, PITCH, SEEK };
+        double time = 0;
+        Op op = OPEN;
+        int id = 0;
+        std::string name; // 以下三项只有 OPEN 用
+        int loop = 0;
+        int priority = 0;
+        double value = 0; // PAUSE/VOLUME/PAN/PITCH/SEEK 的参数
+    };
+
+    struct RenderResult {
+        long long frames = 0;
+        double ms = 0;
+        double framesPerSecond = 0; // 包括解码在内每秒算出的帧数
+        double realtime = 0; // 相对实时播放的倍数
+        unsigned int crc = 0; // 输出 s16 的 CRC-32，两次渲染逐位一致时相同
+        int peak = 0;
+        long long starved = 0; // 流式通道没数据补零的块数，应当为 0
+        bool ok = true; // WAV 写入是否成功
+    };
+
+    // 44 字节的 PCM WAV 头，小端和资源包一样直接按内存写
+    bool writeWavHeader(FILE *f, const int rate, const uint32_t dataBytes) {
+        struct {
+            char riff[4] = {'R', 'I', 'F', 'F'};
+            uint32_t riffSize;
+            char wave[4] = {'W', 'A', 'V', 'E'};
+            char fmt[4] = {'f', 'm', 't', ' '};
+            uint32_t fmtSize = 16;
+            uint16_t format = 1;
+            uint16_t channels = 2;
+            uint32_t rate;
+            uint32_t byteRate;
+            uint16_t blockAlign = 4;
+            uint16_t bits = 16;
+            char data[4] = {'d', 'a', 't', 'a'};
+            uint32_t dataSize;
+        } header;
+        static_assert(sizeof(header) == 44, "wav header layout");
+        header.riffSize = 36 + dataBytes;
+        header.rate = static_cast<uint32_t>(rate);
+        header.byteRate = static_cast<uint32_t>(rate) * 4;
+        header.dataSize = dataBytes;
+        fseek(f, 0, SEEK_SET);
+        return fwrite(&header, sizeof(header), 1, f) == 1;
+    }
+
+    // 用一个独立的 OFFLINE Audio 按时间线渲染 seconds 秒，不碰声卡和 gAudio。
+    // 每条 cue 之前正好渲染到它的采样位置，所以时间精确到帧；out 不为空时保存全部输出，wavPath 不为空时写 WAV
+    RenderResult renderOffline(std::vector<AudioCue> cues, const double seconds, const int rate, const int voices,
+                               const char *wavPath, std::vector<short> *out) {
+        std::stable_sort(cues.begin(), cues.end(), [](const AudioCue &a, const AudioCue &b) {
+            return a.time < b.time;
+        });
+        Audio audio(voices, Audio::OFFLINE, rate);
+        audio.pause(0);
+        RenderResult result;
+        const auto total = static_cast<long long>(std::max(0.0, seconds) * audio.sampleRate());
+        FILE *wav = nullptr;
+        if (wavPath && *wavPath) {
+            wav = fopen(wavPath, "wb");
+            result.ok = wav != nullptr && writeWavHeader(wav, audio.sampleRate(), 0);
+        }
+        if (out) {
+            out->clear();
+            out->reserve(static_cast<size_t>(total) * 2);
+        }
+
+        std::unordered_map<int, Audio::Handle> handles;
+        const auto apply = [&](const AudioCue &cue) {
+            const auto it = handles.find(cue.id);
+            const Audio::Handle handle = it == handles.end() ? -1 : it->second;
+            switch (cue.op) {
+                case AudioCue::OPEN:
+                    handles[cue.id] = audio.open(cue.name.c_str(), cue.loop, cue.priority);
+                    break;
+                case AudioCue::CLOSE:
+                    audio.close(handle);
+                    break;
+                case AudioCue::PAUSE:
+                    audio.pause(handle, static_cast<int>(cue.value));
+                    break;
+                case AudioCue::VOLUME:
+                    audio.volume(handle, static_cast<float>(cue.value));
+                    break;
+                case AudioCue::PAN:
+                    audio.pan(handle, static_cast<float>(cue.value));
+                    break;
+                case AudioCue::PITCH:
+                    audio.pitch(handle, static_cast<float>(cue.value));
+                    break;
+                case AudioCue::SEEK:
+                    audio.seek(handle, cue.value);
+                    break;
+            }
+        };
+
+        constexpr int CHUNK = 4096;
+        std::vector<short> buffer(CHUNK * 2);
+        uint32_t crc = MZ_CRC32_INIT;
+        size_t next = 0;
+        const Uint64 start = SDL_GetPerformanceCounter();
+        while (result.frames < total) {
+            while (next < cues.size() && static_cast<long long>(cues[next].time * audio.sampleRate()) <= result.frames) {
+                apply(cues[next++]);
+            }
+            long long until = total;
+            if (next < cues.size()) {
+                until = std::min(until, static_cast<long long>(cues[next].time * audio.sampleRate()));
+            }
+            const int n = static_cast<int>(std::min<long long>(until - result.frames, CHUNK));
+            audio.render(buffer.data(), n);
+            const size_t count = static_cast<size_t>(n) * 2;
+            crc = static_cast<uint32_t>(mz_crc32(crc, reinterpret_cast<const unsigned char *>(buffer.data()),
+                                                 count * sizeof(short)));
+            for (size_t i = 0; i < count; ++i) {
+                result.peak = std::max(result.peak, std::abs(static_cast<int>(buffer[i])));
+            }
+            if (out) {
+                out->insert(out->end(), buffer.begin(), buffer.begin() + static_cast<ptrdiff_t>(count));
+            }
+            if (wav && result.ok) {
+                result.ok = fwrite(buffer.data(), sizeof(short), count, wav) == count;
+            }
+            result.frames += n;
+        }
+        const double toMs = 1000.0 / static_cast<double>(SDL_GetPerformanceFrequency());
+        result.ms = static_cast<double>(SDL_GetPerformanceCounter() - start) * toMs;
+        result.crc = crc;
+        result.starved = audio.voiceStats().starved;
+        if (result.ms > 0) {
+            result.framesPerSecond = static_cast<double>(result.frames) * 1000.0 / result.ms;
+            result.realtime = result.framesPerSecond / audio.sampleRate();
+        }
+        if (wav) {
+            result.ok = result.ok && writeWavHeader(wav, audio.sampleRate(), static_cast<uint32_t>(result.frames * 4));
+            result.ok = fclose(wav) == 0 && result.ok;
+        }
+        return result;
+    }
+
+
+    struct AttenuateBenchmark {
+        int emitters;
+        double scalarNs; // 每个发声体的耗时
+        double sse2Ns;   // 没有 SSE2 时为 0
+        bool match;
+    };
+
+    // 随机撒在 2048x2048 里的发声体，三种曲线混着，听者在中间
+    AttenuateBenchmark benchmarkAttenuate(const int emitters, const int rounds) {
+        const size_t count = (static_cast<size_t>(std::max(emitters, 4)) + 3) & ~static_cast<size_t>(3);
+        std::vector<float> x(count), y(count), gain(count), near(count), invRange(count), floor(count), scale(count);
+        std::vector<int> curve(count);
+        unsigned int seed = 12345;
+        const auto next = [&seed] {
+            seed = seed * 1664525u + 1013904223u;
+            return static_cast<float>(seed >> 8) / static_cast<float>(1 << 24);
+        };
+        for (size_t i = 0; i < count; ++i) {
+            x[i] = next() * 2048.0f;
+            y[i] = next() * 2048.0f;
+            gain[i] = 0.5f + next() * 0.5f;
+            near[i] = 16.0f + next() * 48.0f;
+            const float far = near[i] + 200.0f + next() * 800.0f;
+            invRange[i] = 1.0f / (far - near[i]);
+            floor[i] = near[i] / far;
+            scale[i] = 1.0f / (1.0f - floor[i]);
+            curve[i] = static_cast<int>(i % 3);
+        }
+        std::vector<float> outGain(count), outPan(count), refGain(count), refPan(count);
+        const EmitterBatch reference{x.data(), y.data(), gain.data(), near.data(), invRange.data(), floor.data(),
+                                     scale.data(), curve.data(), refGain.data(), refPan.data()};
+        const double toNs = 1e9 / static_cast<double>(SDL_GetPerformanceFrequency());
+        const double total = static_cast<double>(count) * std::max(rounds, 1);
+
+        AttenuateBenchmark result{static_cast<int>(count), 0, 0, true};
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int r = 0; r < rounds; ++r) {
+            attenuateFrom(reference, 1024.0f, 1024.0f, 1.0f / 320.0f, 0, count);
+        }
+        result.scalarNs = static_cast<double>(SDL_GetPerformanceCounter() - start) * toNs / total;
+#ifdef MIX_SSE2
+        EmitterBatch batch = reference;
+        batch.outGain = outGain.data();
+        batch.outPan = outPan.data();
+        start = SDL_GetPerformanceCounter();
+        for (int r = 0; r < rounds; ++r) {
+            attenuateSSE2(batch, 1024.0f, 1024.0f, 1.0f / 320.0f, count);
+        }
+        result.sse2Ns = static_cast<double>(SDL_GetPerformanceCounter() - start) * toNs / total;
+        result.match = outGain == refGain && outPan == refPan;
+#endif
+        return result;
+    }
+
+    int failures = 0;
+
+    void check(const bool ok, const char *what) {
+        printf("[%s] %s\n", ok ? "PASS" : "FAIL", what);
+        if (!ok) {
+            ++failures;
+        }
+    }
+
+    void printKernels(const std::vector<std::pair<const char *, double> > &kernelNs) {
+        for (const auto &kernel: kernelNs) {
+            printf(" %s %.3f", kernel.first, kernel.second);
+        }
+        printf("\n");
+    }
+
+    // SIMD 内核的输出必须和标量版本逐位一致
+    void testMixKernels() {
+        printf("mix kernel: %s (ns per output sample)\n", mixKernel().name);
+        bool match = true;
+        for (const int voices: {5, 32, 128}) {
+            const MixBenchmark result = benchmarkMix(voices, 200);
+            printf("  %3d voices: legacy %.3f", result.voices, result.legacyNs);
+            printKernels(result.kernelNs);
+            match = match && result.match;
+        }
+        check(match, "mix kernels match scalar");
+    }
+
+    void testResampleKernels() {
+        printf("resample (ns per channel frame)\n");
+        bool match = true;
+        for (const ResampleBenchmark &result: benchmarkResample(200)) {
+            printf("  %-14s step %.4f:", result.name, result.step);
+            printKernels(result.kernelNs);
+            match = match && result.match;
+        }
+        check(match, "resample kernels match scalar");
+    }
+
+    void testEffectKernels() {
+        printf("effects (ns per frame)\n");
+        bool match = true;
+        for (const EffectBenchmark &result: benchmarkEffects(200, 44100)) {
+            printf("  %-8s:", result.name);
+            printKernels(result.kernelNs);
+            match = match && result.match;
+        }
+        check(match, "effect kernels match scalar");
+    }
+
+    void testAttenuateKernels() {
+        const AttenuateBenchmark result = benchmarkAttenuate(1024, 200);
+        printf("attenuate %d emitters (ns per emitter): scalar %.3f sse2 %.3f\n", result.emitters, result.scalarNs,
+               result.sse2Ns);
+        check(result.match, "attenuate kernels match scalar");
+    }
+
+    // 游戏线程压满命令环，回调一条不丢、顺序不乱
+    void testCommandRing() {
+        Audio audio(16);
+        constexpr long long COUNT = 20000; // 回调每块才取一次，约 20 块就能跑完
+        const Audio::StressResult result = audio.stress(COUNT);
+        printf("command ring: pushed %lld processed %lld errors %lld fullSpins %lld in %.1f ms\n", result.pushed,
+               result.processed, result.errors, result.fullSpins, result.ms);
+        check(result.pushed == COUNT && result.processed == result.pushed && result.errors == 0,
+              "command ring delivers every command in order");
+    }
+
+    // 固定时间线：两个流、变调、跳转、声像和音量渐变都走一遍
+    std::vector<AudioCue> fixedTimeline(const std::string &dir) {
+        std::vector<AudioCue> cues(7);
+        cues[0].op = AudioCue::OPEN;
+        cues[0].id = 1;
+        cues[0].name = dir + "/SadSoul.ogg";
+        cues[1].time = 0.5;
+        cues[1].op = AudioCue::OPEN;
+        cues[1].id = 2;
+        cues[1].name = dir + "/MeetingTheStars.ogg";
+        cues[1].loop = 1;
+        cues[2].time = 1.0;
+        cues[2].op = AudioCue::PITCH;
+        cues[2].id = 2;
+        cues[2].value = 1.5;
+        cues[3].time = 1.5;
+        cues[3].op = AudioCue::PAN;
+        cues[3].id = 1;
+        cues[3].value = -0.75;
+        cues[4].time = 2.0;
+        cues[4].op = AudioCue::SEEK;
+        cues[4].id = 1;
+        cues[4].value = 20.0;
+        cues[5].time = 2.5;
+        cues[5].op = AudioCue::VOLUME;
+        cues[5].id = 2;
+        cues[5].value = 0.3;
+        cues[6].time = 3.5;
+        cues[6].op = AudioCue::CLOSE;
+        cues[6].id = 1;
+        return cues;
+    }
+
+    // 乱序挂上一千条定时音量命令，最后生效的必须是时间最晚、同一时刻里最后到达的那条：
+    // 等渐变走完，输出要和一开始就用那个音量的渲染逐位相同
+    void testScheduledOrder(const std::string &dir) {
+        constexpr int RATE = 44100;
+        constexpr int COMMANDS = 1000;
+        constexpr long long LAST = 30000;
+        const std::string name = dir + "/SadSoul.ogg";
+        std::vector<short> scheduled(RATE * 2);
+        std::vector<short> reference(RATE * 2);
+        float expected = 0;
+        long long late = 0;
+        {
+            Audio audio(4, Audio::OFFLINE, RATE);
+            audio.pause(0);
+            const Audio::Handle handle = audio.open(name.c_str(), 0);
+            unsigned int seed = 12345;
+            for (int i = 0; i < COMMANDS; ++i) {
+                seed = seed * 1664525u + 1013904223u;
+                const float gain = static_cast<float>(seed >> 16 & 0xFF) / 255.0f;
+                const long long time = i % 10 == 0 ? LAST : 1000 + static_cast<long long>(seed >> 8) % (LAST - 1000);
+                if (time == LAST) {
+                    expected = gain;
+                }
+                audio.volume(handle, gain, time);
+            }
+            audio.render(scheduled.data(), RATE);
+            late = audio.voiceStats().lateCommands;
+        }
+        {
+            Audio audio(4, Audio::OFFLINE, RATE);
+            audio.pause(0);
+            audio.volume(audio.open(name.c_str(), 0), expected);
+            audio.render(reference.data(), RATE);
+        }
+        const auto settled = static_cast<std::ptrdiff_t>(LAST + 2048) * 2;
+        check(late == 0 && std::equal(scheduled.begin() + settled, scheduled.end(), reference.begin() + settled),
+              "scheduled commands run in time order, ties in arrival order");
+    }
+
+    // 打开后马上跳转，这时通道还在加载，跳转要挂到加载完再执行；源和输出同为 44100 时不重采样，
+    // 结果应当和不跳转时渲染到同一位置的那一段逐位相同
+    void testSeekWhileLoading(const std::string &dir) {
+        constexpr int RATE = 44100;
+        constexpr double AT = 3.0;
+        std::vector<AudioCue> cues(2);
+        cues[0].op = AudioCue::OPEN;
+        cues[0].id = 1;
+        cues[0].name = dir + "/SadSoul.ogg";
+        cues[1].op = AudioCue::SEEK;
+        cues[1].id = 1;
+        cues[1].value = AT;
+        std::vector<short> seeked;
+        std::vector<short> straight;
+        renderOffline(cues, 1.0, RATE, 4, nullptr, &seeked);
+        cues.pop_back();
+        renderOffline(cues, AT + 1.0, RATE, 4, nullptr, &straight);
+        const auto offset = static_cast<std::ptrdiff_t>(AT * RATE) * 2;
+        check(seeked.size() == RATE * 2 && straight.size() == seeked.size() + static_cast<size_t>(offset) &&
+              std::equal(seeked.begin(), seeked.end(), straight.begin() + offset),
+              "seek sent while loading lands on the exact frame");
+    }
+
+    // 最高音调加上输出采样率低于源：每块要取的输入远多于 1024 帧，PCM 环也得一次供得上
+    void testMaxPitch(const std::string &dir) {
+        std::vector<AudioCue> cues(2);
+        cues[0].op = AudioCue::OPEN;
+        cues[0].id = 1;
+        cues[0].name = dir + "/SadSoul.ogg";
+        cues[1].op = AudioCue::PITCH;
+        cues[1].id = 1;
+        cues[1].value = 4.0;
+        const RenderResult result = renderOffline(cues, 3.0, 32000, 4, nullptr, nullptr);
+        printf("max pitch: starved %lld blocks\n", result.starved);
+        check(result.starved == 0 && result.peak > 0, "stream keeps up at maximum pitch");
+    }
+
+    // 同一条时间线渲染两次，内存里的输出要逐位相同，CRC 也要和输出本身对得上；wav 不为空时把第一次的写出来听
+    void testOfflineRender(const std::string &dir, const char *wav) {
+        constexpr double SECONDS = 5.0;
+        constexpr int RATE = 48000;
+        const std::vector<AudioCue> cues = fixedTimeline(dir);
+        std::vector<short> first;
+        std::vector<short> second;
+        const RenderResult a = renderOffline(cues, SECONDS, RATE, 32, wav, &first);
+        const RenderResult b = renderOffline(cues, SECONDS, RATE, 32, nullptr, &second);
+        printf("offline render: %lld frames in %.1f ms (%.1fx realtime), crc %08x, peak %d\n", a.frames, a.ms,
+               a.realtime, a.crc, a.peak);
+        const auto crc = static_cast<unsigned int>(mz_crc32(MZ_CRC32_INIT,
+                                                            reinterpret_cast<const unsigned char *>(first.data()),
+                                                            first.size() * sizeof(short)));
+        check(a.ok && a.frames == static_cast<long long>(SECONDS * RATE) &&
+              first.size() == static_cast<size_t>(a.frames) * 2 && a.peak > 0 && crc == a.crc,
+              "offline render fills the output buffer");
+        check(first == second && a.crc == b.crc, "offline render is bit-exact across runs");
+    }
+}
+
+int main(int argc, char **argv) {
+    SDL_setenv("SDL_AUDIODRIVER", "dummy", 0); // 没有声卡的机器上回调也照常跑
+    SDL_Init(SDL_INIT_AUDIO);
+    testMixKernels();
+    testResampleKernels();
+    testEffectKernels();
+    testAttenuateKernels();
+    testCommandRing();
+    // mini2d_tests [数据目录] [渲染结果.wav]
+    const std::string dir = argc > 1 ? argv[1] : "../data/extracted";
+    if (FILE *f = fopen((dir + "/SadSoul.ogg").c_str(), "rb")) {
+        fclose(f);
+        testOfflineRender(dir, argc > 2 ? argv[2] : nullptr);
+        testSeekWhileLoading(dir);
+        testScheduledOrder(dir);
+        testMaxPitch(dir);
+    } else {
+        printf("missing test data in %s\n", dir.c_str());
+        check(false, "test data");
+    }
+    SDL_Quit();
+    if (failures > 0) {
+        printf("%d failed\n", failures);
+        return 1;
+    }
+    printf("all passed\n");
+    return 0;
+}
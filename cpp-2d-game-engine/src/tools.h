@@ -0,0 +1,34 @@
+#pragma once
+
+// mini2d_cook 和 mini2d_luac 共用的小工具
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+
+extern "C" {
+#include <lua5.4/lua.h>
+}
+
+namespace tools {
+    inline bool readAll(const std::filesystem::path &path, std::vector<unsigned char> &data) {
+        FILE *f = fopen(path.string().c_str(), "rb");
+        if (f == nullptr) {
+            return false;
+        }
+        fseek(f, 0, SEEK_END);
+        const long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        data.resize(size > 0 ? size : 0);
+        const size_t read = size > 0 ? fread(data.data(), 1, data.size(), f) : 0;
+        fclose(f);
+        return read == data.size();
+    }
+
+    // lua_dump 的 writer，ud 是 std::vector<unsigned char>*
+    inline int writeChunk(lua_State *, const void *p, const size_t size, void *ud) {
+        auto *data = static_cast<std::vector<unsigned char> *>(ud);
+        const auto *bytes = static_cast<const unsigned char *>(p);
+        data->insert(data->end(), bytes, bytes + size);
+        return 0;
+    }
+}